@@ -0,0 +1,735 @@
+#include "volk.h"
+
+#include "compute_kernel.hpp"
+#include "context.hpp"
+#include "dispatch_batcher.hpp"
+#include "gpu_profiler.hpp"
+#include "pipeline_cache.hpp"
+#include "radix_sort.hpp"
+#include "submission_queue.hpp"
+#include "util.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    enum class memory_mode {
+        host_visible,
+        device_local
+    };
+
+    struct bench_options {
+        std::uint64_t minElements = 1ULL << 10;
+        std::uint64_t maxElements = 1ULL << 30;
+        std::uint32_t iterations = 10;
+        std::string format = "csv";
+        std::string outputFile;
+        double peakGBps = 0.0;
+        std::uint32_t smallJobs = 0;
+        bool sort = false;
+        bool maxElementsSet = false;
+    };
+
+    struct bench_result {
+        std::string memory;
+        std::uint32_t workgroupSize;
+        std::uint64_t elements;
+        VkDeviceSize bytes;
+        double meanMs;
+        double minMs;
+        double gbps;
+    };
+
+    struct sort_result {
+        std::string keyType;
+        std::uint64_t elements;
+        double gpuMeanMs;
+        double gpuMinMs;
+        double hostMeanMs;
+        double hostMinMs;
+        bool verified;
+    };
+
+    struct bench_buffer {
+        VkBuffer buffer;
+        memory_allocation memory;
+    };
+
+    // square.comp works on tightly packed floats, four per invocation
+    const VkDeviceSize BYTES_PER_ELEMENT = sizeof(float);
+
+    const char * memoryModeName(memory_mode mode) {
+        return memory_mode::device_local == mode ? "device_local" : "host_visible";
+    }
+
+    bench_buffer createBuffer(context& ctx, VkDeviceSize size, memory_mode mode) {
+        VkBufferCreateInfo bufferCI {};
+        bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferCI.size = size;
+
+        auto properties = memory_mode::device_local == mode
+                ? VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+                : VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        auto out = bench_buffer();
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &out.buffer));
+
+        try {
+            out.memory = ctx.bindMemory(out.buffer, properties);
+        } catch (...) {
+            ctx.vk.vkDestroyBuffer(ctx.device, out.buffer, nullptr);
+            throw;
+        }
+
+        return out;
+    }
+
+    void destroyBuffer(context& ctx, const bench_buffer& buffer) {
+        ctx.vk.vkDestroyBuffer(ctx.device, buffer.buffer, nullptr);
+        ctx.freeMemory(buffer.memory);
+    }
+
+    // runs the recorder once and returns the host round trip in ms; the device time lands in the profiler under label
+    double timeSubmission(gpu_profiler& profiler, submission_queue& queue, const std::string& label, const std::function<void(VkCommandBuffer)>& recorder) {
+        auto start = std::chrono::steady_clock::now();
+
+        auto job = queue.submit([&](VkCommandBuffer commandBuffer) {
+            auto scope = profiler.begin(commandBuffer, label);
+            recorder(commandBuffer);
+            profiler.end(commandBuffer, scope);
+        });
+
+        profiler.endBatch(job);
+        job.wait();
+
+        auto hostMs = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - start).count();
+
+        profiler.collect();
+
+        return hostMs;
+    }
+
+    // prefers the GPU timestamps and falls back to the host round trips
+    double minimumMs(const gpu_profiler& profiler, const std::string& label, const std::vector<double>& hostSamples) {
+        if (profiler.isSupported()) {
+            return profiler.getDeviceStatistics(label).minMs;
+        }
+
+        return *std::min_element(hostSamples.begin(), hostSamples.end());
+    }
+
+    double meanMs(const gpu_profiler& profiler, const std::string& label, const std::vector<double>& hostSamples) {
+        if (profiler.isSupported()) {
+            return profiler.getDeviceStatistics(label).meanMs;
+        }
+
+        double sum = 0.0;
+
+        for (auto sample : hostSamples) {
+            sum += sample;
+        }
+
+        return sum / hostSamples.size();
+    }
+
+    // device-to-device copy bandwidth; the closest thing to a theoretical peak Vulkan can measure
+    double measureCopyBandwidth(context& ctx, gpu_profiler& profiler, submission_queue& queue) {
+        for (VkDeviceSize size = 256 * 1024 * 1024; size >= 1024 * 1024; size /= 2) {
+            bench_buffer src;
+            bench_buffer dst;
+
+            try {
+                src = createBuffer(ctx, size, memory_mode::device_local);
+            } catch (const std::runtime_error&) {
+                continue;
+            }
+
+            try {
+                dst = createBuffer(ctx, size, memory_mode::device_local);
+            } catch (const std::runtime_error&) {
+                destroyBuffer(ctx, src);
+                continue;
+            }
+
+            auto samples = std::vector<double> ();
+            auto label = std::string("copy");
+
+            for (int i = 0; i < 5; i++) {
+                samples.push_back(timeSubmission(profiler, queue, label, [&](VkCommandBuffer commandBuffer) {
+                    VkBufferCopy region {};
+                    region.size = size;
+
+                    ctx.vk.vkCmdCopyBuffer(commandBuffer, src.buffer, dst.buffer, 1, &region);
+                }));
+            }
+
+            destroyBuffer(ctx, dst);
+            destroyBuffer(ctx, src);
+
+            // a copy reads and writes every byte once
+            return 2.0 * size / (minimumMs(profiler, label, samples) * 1.0e6);
+        }
+
+        return 0.0;
+    }
+
+    void writeCsv(std::ostream& out, const std::string& deviceName, double peakGBps, const std::vector<bench_result>& results) {
+        out << "device,memory,workgroup_size,elements,bytes,mean_ms,min_ms,gbps,peak_gbps,efficiency\n";
+
+        for (const auto& r : results) {
+            out << '"' << deviceName << "\","
+                    << r.memory << ','
+                    << r.workgroupSize << ','
+                    << r.elements << ','
+                    << r.bytes << ','
+                    << r.meanMs << ','
+                    << r.minMs << ','
+                    << r.gbps << ','
+                    << peakGBps << ','
+                    << (peakGBps > 0.0 ? r.gbps / peakGBps : 0.0) << '\n';
+        }
+    }
+
+    void writeJson(std::ostream& out, const std::string& deviceName, double peakGBps, const std::vector<bench_result>& results) {
+        out << "{\n";
+        out << "  \"device\": \"" << deviceName << "\",\n";
+        out << "  \"peak_gbps\": " << peakGBps << ",\n";
+        out << "  \"results\": [\n";
+
+        for (std::size_t i = 0; i < results.size(); i++) {
+            const auto& r = results[i];
+
+            out << "    {\"memory\": \"" << r.memory << "\""
+                    << ", \"workgroup_size\": " << r.workgroupSize
+                    << ", \"elements\": " << r.elements
+                    << ", \"bytes\": " << r.bytes
+                    << ", \"mean_ms\": " << r.meanMs
+                    << ", \"min_ms\": " << r.minMs
+                    << ", \"gbps\": " << r.gbps
+                    << ", \"efficiency\": " << (peakGBps > 0.0 ? r.gbps / peakGBps : 0.0)
+                    << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+
+        out << "  ]\n";
+        out << "}\n";
+    }
+
+    // jobs per second for jobCount tiny dispatches, each in its own submit versus coalesced
+    void benchSmallJobs(context& ctx, submission_queue& queue, compute_kernel& kernel, std::uint32_t jobCount, const std::string& format, std::ostream& out) {
+        const std::uint64_t elements = 32;
+
+        auto input = createBuffer(ctx, elements * BYTES_PER_ELEMENT, memory_mode::host_visible);
+        auto output = createBuffer(ctx, elements * BYTES_PER_ELEMENT, memory_mode::host_visible);
+        auto buffers = std::vector<VkBuffer> {input.buffer, output.buffer, input.buffer, output.buffer};
+        auto groupCount = ctx.getGroupCount(elements / 4, ctx.getPreferredWorkgroupSize());
+        auto parameters = std::vector<std::uint32_t> {static_cast<std::uint32_t> (elements)};
+
+        // warm-up: records and caches the dispatch's command buffer and descriptor set
+        kernel.submit(queue, buffers, groupCount, parameters).wait();
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (std::uint32_t i = 0; i < jobCount; i++) {
+            kernel.submit(queue, buffers, groupCount, parameters);
+        }
+
+        queue.waitIdle();
+
+        auto separateSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+
+        {
+            dispatch_batcher batcher(ctx, queue);
+
+            for (std::uint32_t i = 0; i < jobCount; i++) {
+                batcher.dispatch(kernel, buffers, groupCount, parameters);
+            }
+        }
+
+        auto batchedSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+
+        destroyBuffer(ctx, output);
+        destroyBuffer(ctx, input);
+
+        if ("json" == format) {
+            out << "{\n";
+            out << "  \"jobs\": " << jobCount << ",\n";
+            out << "  \"separate_jobs_per_second\": " << jobCount / separateSeconds << ",\n";
+            out << "  \"batched_jobs_per_second\": " << jobCount / batchedSeconds << "\n";
+            out << "}\n";
+        } else {
+            out << "mode,jobs,seconds,jobs_per_second\n";
+            out << "separate," << jobCount << ',' << separateSeconds << ',' << jobCount / separateSeconds << '\n';
+            out << "batched," << jobCount << ',' << batchedSeconds << ',' << jobCount / batchedSeconds << '\n';
+        }
+    }
+
+    // 32-bit keys the same on both sides: uniform u32s, or floats in [-1e6, 1e6) as their bits
+    std::vector<std::uint32_t> makeSortKeys(element_type keyType, std::uint64_t elements) {
+        auto keys = std::vector<std::uint32_t> (elements);
+        std::mt19937 generator(1);
+
+        if (element_type::f32 == keyType) {
+            std::uniform_real_distribution<float> distribution(-1.0e6F, 1.0e6F);
+
+            for (auto& key : keys) {
+                auto value = distribution(generator);
+                std::memcpy(&key, &value, sizeof(key));
+            }
+        } else {
+            for (auto& key : keys) {
+                key = static_cast<std::uint32_t> (generator());
+            }
+        }
+
+        return keys;
+    }
+
+    // std::sort of a copy of keys, by value, into sorted; returns the time in ms of the sort alone
+    double sortOnHost(element_type keyType, const std::vector<std::uint32_t>& keys, std::vector<std::uint32_t>& sorted) {
+        if (element_type::f32 == keyType) {
+            auto values = std::vector<float> (keys.size());
+            std::memcpy(values.data(), keys.data(), keys.size() * sizeof(float));
+
+            auto start = std::chrono::steady_clock::now();
+            std::sort(values.begin(), values.end());
+            auto ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - start).count();
+
+            sorted.resize(keys.size());
+            std::memcpy(sorted.data(), values.data(), keys.size() * sizeof(float));
+
+            return ms;
+        }
+
+        sorted = keys;
+
+        auto start = std::chrono::steady_clock::now();
+        std::sort(sorted.begin(), sorted.end());
+
+        return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - start).count();
+    }
+
+    // radix_sorter against std::sort over the same keys, u32 and f32, at every element count
+    std::vector<sort_result> benchSort(context& ctx, gpu_profiler& profiler, submission_queue& queue, VkPipelineCache pipelineCache, const bench_options& options) {
+        const auto& limits = ctx.physicalDeviceProperties.limits;
+
+        radix_sorter sorter(ctx, pipelineCache);
+
+        auto results = std::vector<sort_result> ();
+
+        for (auto keyType : {element_type::u32, element_type::f32}) {
+            auto keyTypeName = elementwise_library::getTypeName(keyType);
+
+            for (auto elements = options.minElements; elements <= options.maxElements; elements *= 4) {
+                auto bytes = elements * sizeof(std::uint32_t);
+
+                if (bytes > limits.maxStorageBufferRange || elements > UINT32_MAX) {
+                    std::cerr << "Skipping " << elements << " keys: exceeds maxStorageBufferRange\n";
+                    continue;
+                }
+
+                auto count = static_cast<std::uint32_t> (elements);
+                auto keys = makeSortKeys(keyType, elements);
+
+                bench_buffer source;
+                bench_buffer sortBuffer;
+
+                try {
+                    source = createBuffer(ctx, bytes, memory_mode::host_visible);
+                } catch (const std::runtime_error& ex) {
+                    std::cerr << "Skipping " << elements << " keys: " << ex.what() << "\n";
+                    continue;
+                }
+
+                try {
+                    sortBuffer = createBuffer(ctx, bytes, memory_mode::device_local);
+                    sorter.prepare(count, false);
+                } catch (const std::runtime_error& ex) {
+                    std::cerr << "Skipping " << elements << " keys: " << ex.what() << "\n";
+                    destroyBuffer(ctx, source);
+                    continue;
+                }
+
+                std::memcpy(source.memory.pMapped, keys.data(), bytes);
+
+                VkBufferCopy region {};
+                region.size = bytes;
+
+                // every sort starts from the unsorted keys
+                auto reset = [&](VkCommandBuffer commandBuffer) {
+                    ctx.vk.vkCmdCopyBuffer(commandBuffer, source.buffer, sortBuffer.buffer, 1, &region);
+
+                    VkMemoryBarrier barrier {};
+                    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+                    ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+                };
+
+                auto recorder = [&](VkCommandBuffer commandBuffer) {
+                    sorter.record(commandBuffer, keyType, sortBuffer.buffer, count);
+                };
+
+                auto label = std::string("sort/") + keyTypeName + "/" + std::to_string(elements);
+                auto gpuSamples = std::vector<double> ();
+                auto hostSamples = std::vector<double> ();
+
+                // every submission is waited for, so one session with no job to track covers them all
+                sorter.beginRecording();
+
+                // warm-up: first use of the pipelines, page faults on fresh allocations
+                queue.submit(reset).wait();
+                queue.submit(recorder).wait();
+
+                for (std::uint32_t i = 0; i < options.iterations; i++) {
+                    queue.submit(reset).wait();
+                    gpuSamples.push_back(timeSubmission(profiler, queue, label, recorder));
+                }
+
+                sorter.endRecording(job_future());
+
+                // the sorted keys come back through the source buffer
+                queue.submit([&](VkCommandBuffer commandBuffer) {
+                    VkMemoryBarrier barrier {};
+                    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+                    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+                    ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+                    ctx.vk.vkCmdCopyBuffer(commandBuffer, sortBuffer.buffer, source.buffer, 1, &region);
+
+                    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+                    ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+                }).wait();
+
+                auto sorted = std::vector<std::uint32_t> ();
+
+                for (std::uint32_t i = 0; i < options.iterations; i++) {
+                    hostSamples.push_back(sortOnHost(keyType, keys, sorted));
+                }
+
+                auto result = sort_result();
+                result.keyType = keyTypeName;
+                result.elements = elements;
+                result.gpuMeanMs = meanMs(profiler, label, gpuSamples);
+                result.gpuMinMs = minimumMs(profiler, label, gpuSamples);
+                result.hostMeanMs = std::accumulate(hostSamples.begin(), hostSamples.end(), 0.0) / hostSamples.size();
+                result.hostMinMs = *std::min_element(hostSamples.begin(), hostSamples.end());
+                // the random floats hold no -0 or NaN, so equal values have equal bits
+                result.verified = 0 == std::memcmp(source.memory.pMapped, sorted.data(), bytes);
+
+                if (!result.verified) {
+                    std::cerr << "Sorting " << elements << " " << keyTypeName << " keys on the device gave a different order than std::sort!\n";
+                }
+
+                results.push_back(result);
+
+                // the next configuration's buffers may get the same handles
+                sorter.forget(sortBuffer.buffer);
+
+                destroyBuffer(ctx, sortBuffer);
+                destroyBuffer(ctx, source);
+            }
+        }
+
+        return results;
+    }
+
+    void writeSortCsv(std::ostream& out, const std::string& deviceName, const std::vector<sort_result>& results) {
+        out << "device,key_type,elements,gpu_mean_ms,gpu_min_ms,host_mean_ms,host_min_ms,speedup,verified\n";
+
+        for (const auto& r : results) {
+            out << '"' << deviceName << "\","
+                    << r.keyType << ','
+                    << r.elements << ','
+                    << r.gpuMeanMs << ','
+                    << r.gpuMinMs << ','
+                    << r.hostMeanMs << ','
+                    << r.hostMinMs << ','
+                    << r.hostMinMs / r.gpuMinMs << ','
+                    << (r.verified ? "true" : "false") << '\n';
+        }
+    }
+
+    void writeSortJson(std::ostream& out, const std::string& deviceName, const std::vector<sort_result>& results) {
+        out << "{\n";
+        out << "  \"device\": \"" << deviceName << "\",\n";
+        out << "  \"sort_results\": [\n";
+
+        for (std::size_t i = 0; i < results.size(); i++) {
+            const auto& r = results[i];
+
+            out << "    {\"key_type\": \"" << r.keyType << "\""
+                    << ", \"elements\": " << r.elements
+                    << ", \"gpu_mean_ms\": " << r.gpuMeanMs
+                    << ", \"gpu_min_ms\": " << r.gpuMinMs
+                    << ", \"host_mean_ms\": " << r.hostMeanMs
+                    << ", \"host_min_ms\": " << r.hostMinMs
+                    << ", \"speedup\": " << r.hostMinMs / r.gpuMinMs
+                    << ", \"verified\": " << (r.verified ? "true" : "false")
+                    << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+
+        out << "  ]\n";
+        out << "}\n";
+    }
+
+    bench_options parseOptions(int argc, char** argv) {
+        auto options = bench_options();
+
+        for (int i = 1; i < argc; i++) {
+            auto arg = std::string(argv[i]);
+            auto hasValue = i + 1 < argc;
+
+            if ("--min-elements" == arg && hasValue) {
+                options.minElements = std::strtoull(argv[++i], nullptr, 10);
+            } else if ("--max-elements" == arg && hasValue) {
+                options.maxElements = std::strtoull(argv[++i], nullptr, 10);
+                options.maxElementsSet = true;
+            } else if ("--iterations" == arg && hasValue) {
+                options.iterations = std::strtoul(argv[++i], nullptr, 10);
+            } else if ("--format" == arg && hasValue) {
+                options.format = argv[++i];
+            } else if ("--output" == arg && hasValue) {
+                options.outputFile = argv[++i];
+            } else if ("--peak-gbps" == arg && hasValue) {
+                options.peakGBps = std::strtod(argv[++i], nullptr);
+            } else if ("--small-jobs" == arg && hasValue) {
+                options.smallJobs = std::strtoul(argv[++i], nullptr, 10);
+            } else if ("--sort" == arg) {
+                options.sort = true;
+            } else {
+                throw std::runtime_error("Unknown argument: " + arg);
+            }
+        }
+
+        if ("csv" != options.format && "json" != options.format) {
+            throw std::runtime_error("--format must be csv or json");
+        }
+
+        if (0 == options.iterations) {
+            options.iterations = 1;
+        }
+
+        // std::sort of a billion keys, ten times over, is not a benchmark anyone waits for
+        if (options.sort && !options.maxElementsSet) {
+            options.maxElements = 1ULL << 24;
+        }
+
+        return options;
+    }
+}
+
+// Sweeps square.comp over element count, workgroup size and memory placement, or with --sort times
+// radix_sorter against std::sort.
+int main(int argc, char** argv) {
+    auto options = parseOptions(argc, argv);
+
+    context ctx;
+
+    const auto& limits = ctx.physicalDeviceProperties.limits;
+    auto deviceName = std::string(ctx.physicalDeviceProperties.deviceName);
+
+    pipeline_cache pipelineCache(ctx, "pipeline.cache");
+    gpu_profiler profiler(ctx, ctx.computeQueueFamilyIds[0]);
+    submission_queue queue(ctx, ctx.computeQueueFamilyIds[0]);
+
+    if (options.smallJobs > 0) {
+        compute_kernel kernel(ctx, "square", readFile("square.comp.spv"), 4, pipelineCache.cache, {ctx.getPreferredWorkgroupSize()}, 1);
+
+        if (options.outputFile.empty()) {
+            benchSmallJobs(ctx, queue, kernel, options.smallJobs, options.format, std::cout);
+        } else {
+            std::ofstream file(options.outputFile.c_str(), std::ios::out | std::ios::trunc);
+
+            if (!file.is_open()) {
+                throw std::runtime_error("Unable to open file: " + options.outputFile);
+            }
+
+            benchSmallJobs(ctx, queue, kernel, options.smallJobs, options.format, file);
+        }
+
+        return 0;
+    }
+
+    if (!profiler.isSupported()) {
+        std::cerr << "Timestamps are not supported on this queue; falling back to host timing.\n";
+    }
+
+    if (options.sort) {
+        auto results = benchSort(ctx, profiler, queue, pipelineCache.cache, options);
+
+        if (options.outputFile.empty()) {
+            if ("json" == options.format) {
+                writeSortJson(std::cout, deviceName, results);
+            } else {
+                writeSortCsv(std::cout, deviceName, results);
+            }
+        } else {
+            std::ofstream file(options.outputFile.c_str(), std::ios::out | std::ios::trunc);
+
+            if (!file.is_open()) {
+                throw std::runtime_error("Unable to open file: " + options.outputFile);
+            }
+
+            if ("json" == options.format) {
+                writeSortJson(file, deviceName, results);
+            } else {
+                writeSortCsv(file, deviceName, results);
+            }
+        }
+
+        return 0;
+    }
+
+    auto peakGBps = options.peakGBps > 0.0 ? options.peakGBps : measureCopyBandwidth(ctx, profiler, queue);
+
+    std::cerr << deviceName << ": reference bandwidth " << peakGBps << " GB/s\n";
+
+    auto spvCode = readFile("square.comp.spv");
+    auto kernels = std::map<std::uint32_t, std::unique_ptr<compute_kernel>> ();
+
+    for (std::uint32_t workgroupSize = 32; workgroupSize <= 1024; workgroupSize *= 2) {
+        if (workgroupSize > limits.maxComputeWorkGroupSize[0] || workgroupSize > limits.maxComputeWorkGroupInvocations) {
+            break;
+        }
+
+        kernels[workgroupSize] = std::make_unique<compute_kernel> (ctx, "square", spvCode, 4, pipelineCache.cache, std::vector<std::uint32_t> {workgroupSize}, 1);
+    }
+
+    auto results = std::vector<bench_result> ();
+
+    for (auto mode : {memory_mode::host_visible, memory_mode::device_local}) {
+        for (auto elements = options.minElements; elements <= options.maxElements; elements *= 4) {
+            auto bytes = elements * BYTES_PER_ELEMENT;
+
+            if (bytes > limits.maxStorageBufferRange) {
+                std::cerr << "Skipping " << elements << " elements: exceeds maxStorageBufferRange\n";
+                continue;
+            }
+
+            bench_buffer input;
+            bench_buffer output;
+
+            try {
+                input = createBuffer(ctx, bytes, mode);
+            } catch (const std::runtime_error& ex) {
+                std::cerr << "Skipping " << memoryModeName(mode) << " " << elements << " elements: " << ex.what() << "\n";
+                continue;
+            }
+
+            try {
+                output = createBuffer(ctx, bytes, mode);
+            } catch (const std::runtime_error& ex) {
+                std::cerr << "Skipping " << memoryModeName(mode) << " " << elements << " elements: " << ex.what() << "\n";
+                destroyBuffer(ctx, input);
+                continue;
+            }
+
+            queue.submit([&](VkCommandBuffer commandBuffer) {
+                // 1.0f; the values do not matter for bandwidth, only that they are finite
+                ctx.vk.vkCmdFillBuffer(commandBuffer, input.buffer, 0, VK_WHOLE_SIZE, 0x3F800000);
+
+                VkMemoryBarrier barrier {};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+                ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+            }).wait();
+
+            auto buffers = std::vector<VkBuffer> {input.buffer, output.buffer, input.buffer, output.buffer};
+            auto invocationCount = std::max(elements / 4, elements % 4);
+            auto parameters = std::vector<std::uint32_t> {static_cast<std::uint32_t> (elements)};
+
+            for (const auto& entry : kernels) {
+                auto workgroupSize = entry.first;
+                auto& kernel = *entry.second;
+                auto groupCount = ctx.getGroupCount(invocationCount, workgroupSize);
+
+                auto label = std::string(memoryModeName(mode)) + "/" + std::to_string(workgroupSize) + "/" + std::to_string(elements);
+                auto hostSamples = std::vector<double> ();
+
+                auto recorder = [&](VkCommandBuffer commandBuffer) {
+                    kernel.record(commandBuffer, buffers, groupCount, parameters);
+                };
+
+                // every submission is waited for, so one session with no job to track covers them all
+                kernel.beginRecording();
+
+                // warm-up: first use of the pipeline, page faults on fresh allocations
+                queue.submit(recorder).wait();
+
+                for (std::uint32_t i = 0; i < options.iterations; i++) {
+                    hostSamples.push_back(timeSubmission(profiler, queue, label, recorder));
+                }
+
+                kernel.endRecording(job_future());
+
+                auto result = bench_result();
+                result.memory = memoryModeName(mode);
+                result.workgroupSize = workgroupSize;
+                result.elements = elements;
+                result.bytes = bytes;
+                result.meanMs = meanMs(profiler, label, hostSamples);
+                result.minMs = minimumMs(profiler, label, hostSamples);
+
+                // the kernel reads the input and writes the output once
+                result.gbps = 2.0 * bytes / (result.meanMs * 1.0e6);
+
+                results.push_back(result);
+            }
+
+            // the next configuration's buffers may get the same handles
+            for (const auto& entry : kernels) {
+                entry.second->forget(input.buffer);
+                entry.second->forget(output.buffer);
+            }
+
+            destroyBuffer(ctx, output);
+            destroyBuffer(ctx, input);
+        }
+    }
+
+    if (options.outputFile.empty()) {
+        if ("json" == options.format) {
+            writeJson(std::cout, deviceName, peakGBps, results);
+        } else {
+            writeCsv(std::cout, deviceName, peakGBps, results);
+        }
+    } else {
+        std::ofstream file(options.outputFile.c_str(), std::ios::out | std::ios::trunc);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file: " + options.outputFile);
+        }
+
+        if ("json" == options.format) {
+            writeJson(file, deviceName, peakGBps, results);
+        } else {
+            writeCsv(file, deviceName, peakGBps, results);
+        }
+    }
+
+    return 0;
+}
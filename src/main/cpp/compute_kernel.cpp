@@ -0,0 +1,397 @@
+#include "compute_kernel.hpp"
+
+#include "gpu_profiler.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+compute_kernel::compute_kernel(context& ctx, const std::string& name, const std::vector<char>& spvCode, std::uint32_t bindingCount, VkPipelineCache pipelineCache, const std::vector<std::uint32_t>& specializationConstants, std::uint32_t pushConstantCount) : name(name), ctx(ctx), bindingCount(bindingCount), pushConstantCount(pushConstantCount), descriptors(ctx) {
+    if (pushConstantCount * sizeof(std::uint32_t) > ctx.physicalDeviceProperties.limits.maxPushConstantsSize) {
+        throw std::runtime_error("Kernel needs more push constants than the device supports!");
+    }
+
+    pushDescriptors = 0 != ctx.maxPushDescriptors && bindingCount <= ctx.maxPushDescriptors;
+    openRecordings = 0;
+
+    auto descriptorSetLayoutBindings = std::vector<VkDescriptorSetLayoutBinding>();
+
+    for (std::uint32_t i = 0; i < bindingCount; i++) {
+        VkDescriptorSetLayoutBinding binding {};
+        binding.binding = i;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        descriptorSetLayoutBindings.push_back(binding);
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI {};
+    descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCI.bindingCount = descriptorSetLayoutBindings.size();
+    descriptorSetLayoutCI.pBindings = descriptorSetLayoutBindings.data();
+
+#if defined(VK_KHR_push_descriptor)
+    if (pushDescriptors) {
+        descriptorSetLayoutCI.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+    }
+#endif
+
+    vkAssert(ctx.vk.vkCreateDescriptorSetLayout(ctx.device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCI {};
+    pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCI.setLayoutCount = 1;
+    pipelineLayoutCI.pSetLayouts = &descriptorSetLayout;
+
+    VkPushConstantRange pushConstantRange {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pushConstantCount * sizeof(std::uint32_t);
+
+    if (0 != pushConstantCount) {
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    }
+
+    vkAssert(ctx.vk.vkCreatePipelineLayout(ctx.device, &pipelineLayoutCI, nullptr, &pipelineLayout));
+
+    VkShaderModuleCreateInfo shaderModuleCI {};
+    shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCI.codeSize = spvCode.size();
+    shaderModuleCI.pCode = reinterpret_cast<const std::uint32_t *> (spvCode.data());
+
+    VkShaderModule computeShaderModule = VK_NULL_HANDLE;
+    vkAssert(ctx.vk.vkCreateShaderModule(ctx.device, &shaderModuleCI, nullptr, &computeShaderModule));
+
+    auto specializationEntries = std::vector<VkSpecializationMapEntry> ();
+
+    for (std::uint32_t i = 0; i < specializationConstants.size(); i++) {
+        VkSpecializationMapEntry entry {};
+        entry.constantID = i;
+        entry.offset = i * sizeof(std::uint32_t);
+        entry.size = sizeof(std::uint32_t);
+
+        specializationEntries.push_back(entry);
+    }
+
+    VkSpecializationInfo specializationInfo {};
+    specializationInfo.mapEntryCount = specializationEntries.size();
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = specializationConstants.size() * sizeof(std::uint32_t);
+    specializationInfo.pData = specializationConstants.data();
+
+    VkPipelineShaderStageCreateInfo computeStageCI {};
+    computeStageCI.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    computeStageCI.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    computeStageCI.module = computeShaderModule;
+    computeStageCI.pName = "main";
+    computeStageCI.pSpecializationInfo = specializationConstants.empty() ? nullptr : &specializationInfo;
+
+    VkComputePipelineCreateInfo computePipelineCI {};
+    computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    computePipelineCI.stage = computeStageCI;
+    computePipelineCI.layout = pipelineLayout;
+
+    vkAssert(ctx.vk.vkCreateComputePipelines(ctx.device, pipelineCache, 1, &computePipelineCI, nullptr, &pipeline));
+
+    ctx.vk.vkDestroyShaderModule(ctx.device, computeShaderModule, nullptr);
+
+    VkCommandPoolCreateInfo commandPoolCI {};
+    commandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCI.queueFamilyIndex = ctx.computeQueueFamilyIds[0];
+
+    vkAssert(ctx.vk.vkCreateCommandPool(ctx.device, &commandPoolCI, nullptr, &commandPool));
+
+    VkFenceCreateInfo fenceCI {};
+    fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    vkAssert(ctx.vk.vkCreateFence(ctx.device, &fenceCI, nullptr, &fence));
+
+    ctx.vk.vkGetDeviceQueue(ctx.device, ctx.computeQueueFamilyIds[0], 0, &queue);
+}
+
+compute_kernel::~compute_kernel() {
+    waitPendingJobs();
+
+    ctx.vk.vkDestroyFence(ctx.device, fence, nullptr);
+    ctx.vk.vkDestroyCommandPool(ctx.device, commandPool, nullptr);
+    ctx.vk.vkDestroyPipeline(ctx.device, pipeline, nullptr);
+    ctx.vk.vkDestroyPipelineLayout(ctx.device, pipelineLayout, nullptr);
+    ctx.vk.vkDestroyDescriptorSetLayout(ctx.device, descriptorSetLayout, nullptr);
+}
+
+bool compute_kernel::needsDescriptorSet() const {
+    return !pushDescriptors && 0 != bindingCount;
+}
+
+void compute_kernel::beginRecording() {
+    if (0 == openRecordings && isCacheFull()) {
+        flushCaches();
+    }
+
+    openRecordings++;
+}
+
+void compute_kernel::endRecording(const job_future& job) {
+    if (0 == openRecordings) {
+        throw std::runtime_error("Kernel recording session was ended without being begun!");
+    }
+
+    openRecordings--;
+    track(job);
+}
+
+void compute_kernel::record(VkCommandBuffer commandBuffer, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) {
+    if (0 == openRecordings) {
+        throw std::runtime_error("Kernel was recorded outside a recording session!");
+    }
+
+    recordCached(commandBuffer, buffers, groupCount, pushConstants);
+}
+
+void compute_kernel::recordCached(VkCommandBuffer commandBuffer, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) {
+    auto descriptorSet = needsDescriptorSet() ? getDescriptorSet(buffers) : VK_NULL_HANDLE;
+
+    auto scope = nullptr != ctx.profiler ? ctx.profiler->begin(commandBuffer, name) : 0;
+
+    recordDispatch(commandBuffer, descriptorSet, buffers, groupCount, pushConstants);
+
+    if (nullptr != ctx.profiler) {
+        ctx.profiler->end(commandBuffer, scope);
+    }
+}
+
+void compute_kernel::record(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) const {
+    if (needsDescriptorSet()) {
+        writeDescriptorSet(descriptorSet, buffers);
+    }
+
+    recordDispatch(commandBuffer, descriptorSet, buffers, groupCount, pushConstants);
+}
+
+void compute_kernel::recordDispatch(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) const {
+    if (buffers.size() != bindingCount) {
+        throw std::runtime_error("Kernel was given the wrong number of buffers!");
+    }
+
+    if (pushConstants.size() != pushConstantCount) {
+        throw std::runtime_error("Kernel was given the wrong number of push constants!");
+    }
+
+    ctx.vk.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    // a kernel without bindings reaches its data through addresses in the push constants
+    if (pushDescriptors && 0 != bindingCount) {
+        pushDescriptorSet(ctx, commandBuffer, pipelineLayout, toBindings(buffers));
+    } else if (needsDescriptorSet()) {
+        ctx.vk.vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    }
+
+    if (0 != pushConstantCount) {
+        ctx.vk.vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantCount * sizeof(std::uint32_t), pushConstants.data());
+    }
+
+    ctx.vk.vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+}
+
+void compute_kernel::dispatch(const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) {
+    if (nullptr != ctx.profiler) {
+        // this submission bypasses submission_queue, so the profiler is told about it directly
+        auto commandBuffer = recordCommandBuffer(buffers, groupCount, pushConstants, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+        VkSubmitInfo submitInfo {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        auto submitTime = std::chrono::steady_clock::now();
+
+        vkAssert(ctx.vk.vkQueueSubmit(queue, 1, &submitInfo, fence));
+        ctx.profiler->endBatch(job_future(), submitTime);
+        vkAssert(ctx.vk.vkWaitForFences(ctx.device, 1, &fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+        ctx.profiler->observeCompletions();
+        vkAssert(ctx.vk.vkResetFences(ctx.device, 1, &fence));
+
+        ctx.vk.vkFreeCommandBuffers(ctx.device, commandPool, 1, &commandBuffer);
+        ctx.profiler->collect();
+
+        return;
+    }
+
+    auto commandBuffer = getCommandBuffer(buffers, groupCount, pushConstants);
+
+    VkSubmitInfo submitInfo {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    vkAssert(ctx.vk.vkQueueSubmit(queue, 1, &submitInfo, fence));
+    vkAssert(ctx.vk.vkWaitForFences(ctx.device, 1, &fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+    vkAssert(ctx.vk.vkResetFences(ctx.device, 1, &fence));
+}
+
+job_future compute_kernel::submit(submission_queue& queue, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) {
+    auto job = job_future();
+
+    // cached command buffers come from a pool of the first compute family and cannot run elsewhere
+    if (nullptr != ctx.profiler || queue.getQueueFamilyIndex() != ctx.computeQueueFamilyIds[0]) {
+        job = queue.submit([&](VkCommandBuffer commandBuffer) {
+            recordCached(commandBuffer, buffers, groupCount, pushConstants);
+        });
+    } else {
+        job = queue.submit(getCommandBuffer(buffers, groupCount, pushConstants));
+    }
+
+    track(job);
+
+    return job;
+}
+
+void compute_kernel::track(const job_future& job) {
+    pendingJobs.erase(std::remove_if(pendingJobs.begin(), pendingJobs.end(), [](const job_future& pending) {
+        return pending.isReady();
+    }), pendingJobs.end());
+
+    pendingJobs.push_back(job);
+}
+
+void compute_kernel::waitPendingJobs() {
+    for (const auto& job : pendingJobs) {
+        job.wait();
+    }
+
+    pendingJobs.clear();
+}
+
+bool compute_kernel::isCacheFull() const {
+    return descriptors.getAllocatedCount() >= MAX_CACHED_BINDINGS || commandBuffers.size() >= MAX_CACHED_BINDINGS;
+}
+
+void compute_kernel::flushCaches() {
+    // every cached command buffer references one of the cached sets, so both caches go together.
+    // dispatch() always waits for completion, and closed recording sessions tracked their jobs.
+    waitPendingJobs();
+
+    vkAssert(ctx.vk.vkResetCommandPool(ctx.device, commandPool, 0));
+
+    for (const auto& entry : commandBuffers) {
+        ctx.vk.vkFreeCommandBuffers(ctx.device, commandPool, 1, &entry.second);
+    }
+
+    commandBuffers.clear();
+    descriptors.clear();
+}
+
+VkDescriptorSet compute_kernel::getDescriptorSet(const std::vector<VkBuffer>& buffers) {
+    if (buffers.size() != bindingCount) {
+        throw std::runtime_error("Kernel was given the wrong number of buffers!");
+    }
+
+    auto bindings = toBindings(buffers);
+
+    // the pools grow on demand, and sets dropped by forget() stay allocated until the flush, so
+    // counting them too is what keeps the number of pools bounded. Only a miss allocates, and
+    // inside a recording session the sets bound so far must survive, so the pools grow instead.
+    if (0 == openRecordings && descriptors.getAllocatedCount() >= MAX_CACHED_BINDINGS && !descriptors.contains(descriptorSetLayout, bindings)) {
+        flushCaches();
+    }
+
+    return descriptors.get(descriptorSetLayout, bindings);
+}
+
+void compute_kernel::writeDescriptorSet(VkDescriptorSet descriptorSet, const std::vector<VkBuffer>& buffers) const {
+    if (buffers.size() != bindingCount) {
+        throw std::runtime_error("Kernel was given the wrong number of buffers!");
+    }
+
+    ::writeDescriptorSet(ctx, descriptorSet, toBindings(buffers));
+}
+
+std::vector<descriptor_binding> compute_kernel::toBindings(const std::vector<VkBuffer>& buffers) {
+    auto bindings = std::vector<descriptor_binding> ();
+
+    for (auto buffer : buffers) {
+        bindings.push_back(descriptor_binding {buffer, 0, VK_WHOLE_SIZE});
+    }
+
+    return bindings;
+}
+
+void compute_kernel::forget(VkBuffer buffer) {
+    auto stale = std::vector<VkCommandBuffer> ();
+
+    for (auto it = commandBuffers.begin(); it != commandBuffers.end();) {
+        const auto& buffers = std::get<0> (it->first);
+
+        if (std::find(buffers.begin(), buffers.end(), buffer) != buffers.end()) {
+            stale.push_back(it->second);
+            it = commandBuffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (!stale.empty()) {
+        // a submitted job may still be executing one of them
+        waitPendingJobs();
+
+        ctx.vk.vkFreeCommandBuffers(ctx.device, commandPool, stale.size(), stale.data());
+    }
+
+    descriptors.invalidate(buffer);
+}
+
+std::size_t compute_kernel::getDescriptorPoolCount() const {
+    return descriptors.getPoolCount();
+}
+
+VkCommandBuffer compute_kernel::getCommandBuffer(const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) {
+    auto key = dispatch_key(buffers, groupCount, pushConstants);
+    auto it = commandBuffers.find(key);
+
+    if (it != commandBuffers.end()) {
+        return it->second;
+    }
+
+    // either may flush both caches, so both come before allocating the command buffer
+    if (0 == openRecordings && commandBuffers.size() >= MAX_CACHED_BINDINGS) {
+        flushCaches();
+    }
+
+    if (needsDescriptorSet()) {
+        getDescriptorSet(buffers);
+    }
+
+    // submit() may queue the same dispatch again before the previous one has finished
+    auto commandBuffer = recordCommandBuffer(buffers, groupCount, pushConstants, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+
+    commandBuffers[key] = commandBuffer;
+
+    return commandBuffer;
+}
+
+VkCommandBuffer compute_kernel::recordCommandBuffer(const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants, VkCommandBufferUsageFlags usage) {
+    VkCommandBufferAllocateInfo commandBufferAI {};
+    commandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAI.commandPool = commandPool;
+    commandBufferAI.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    vkAssert(ctx.vk.vkAllocateCommandBuffers(ctx.device, &commandBufferAI, &commandBuffer));
+
+    VkCommandBufferBeginInfo commandBufferBI {};
+    commandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBI.flags = usage;
+
+    vkAssert(ctx.vk.vkBeginCommandBuffer(commandBuffer, &commandBufferBI));
+
+    recordCached(commandBuffer, buffers, groupCount, pushConstants);
+
+    vkAssert(ctx.vk.vkEndCommandBuffer(commandBuffer));
+
+    return commandBuffer;
+}
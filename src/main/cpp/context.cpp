@@ -0,0 +1,605 @@
+#include "context.hpp"
+
+#include "util.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+    bool hasInstanceLayer(const char * layerName) {
+        std::uint32_t nLayers = 0;
+        vkAssert(vkEnumerateInstanceLayerProperties(&nLayers, nullptr));
+        auto layers = std::vector<VkLayerProperties> (nLayers);
+        vkAssert(vkEnumerateInstanceLayerProperties(&nLayers, layers.data()));
+
+        for (const auto& layer : layers) {
+            if (0 == std::strcmp(layerName, layer.layerName)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool hasInstanceExtension(const char * extensionName) {
+        std::uint32_t nExtensions = 0;
+        vkAssert(vkEnumerateInstanceExtensionProperties(nullptr, &nExtensions, nullptr));
+        auto extensions = std::vector<VkExtensionProperties> (nExtensions);
+        vkAssert(vkEnumerateInstanceExtensionProperties(nullptr, &nExtensions, extensions.data()));
+
+        for (const auto& extension : extensions) {
+            if (0 == std::strcmp(extensionName, extension.extensionName)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool hasDeviceExtension(VkPhysicalDevice physicalDevice, const char * extensionName) {
+        std::uint32_t nExtensions = 0;
+        vkAssert(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &nExtensions, nullptr));
+        auto extensions = std::vector<VkExtensionProperties> (nExtensions);
+        vkAssert(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &nExtensions, extensions.data()));
+
+        for (const auto& extension : extensions) {
+            if (0 == std::strcmp(extensionName, extension.extensionName)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // VK_KHR_push_descriptor depends on VK_KHR_get_physical_device_properties2, which createInstance()
+    // enables whenever the loader has it; 0 means push descriptors are unavailable
+    std::uint32_t queryMaxPushDescriptors(VkPhysicalDevice physicalDevice) {
+#if defined(VK_KHR_push_descriptor) && defined(VK_KHR_get_physical_device_properties2)
+        if (nullptr != vkGetPhysicalDeviceProperties2KHR && hasDeviceExtension(physicalDevice, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME)) {
+            VkPhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProperties {};
+            pushDescriptorProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR;
+
+            VkPhysicalDeviceProperties2KHR properties2 {};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &pushDescriptorProperties;
+
+            vkGetPhysicalDeviceProperties2KHR(physicalDevice, &properties2);
+
+            return pushDescriptorProperties.maxPushDescriptors;
+        }
+#endif
+
+        return 0;
+    }
+
+    // VK_EXT_external_memory_host sits on VK_KHR_external_memory, whose instance half createInstance()
+    // enables when present; 0 means host pointers cannot be imported
+    VkDeviceSize queryMinImportedHostPointerAlignment(VkPhysicalDevice physicalDevice) {
+#if defined(VK_EXT_external_memory_host) && defined(VK_KHR_external_memory_capabilities) && defined(VK_KHR_get_physical_device_properties2)
+        if (nullptr == vkGetPhysicalDeviceProperties2KHR || nullptr == vkGetPhysicalDeviceExternalBufferPropertiesKHR
+                || !hasDeviceExtension(physicalDevice, VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME)
+                || !hasDeviceExtension(physicalDevice, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+            return 0;
+        }
+
+        VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties {};
+        hostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+
+        VkPhysicalDeviceProperties2KHR properties2 {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &hostProperties;
+
+        vkGetPhysicalDeviceProperties2KHR(physicalDevice, &properties2);
+
+        return hostProperties.minImportedHostPointerAlignment;
+#else
+        return 0;
+#endif
+    }
+
+    bool queryMemoryBudget(VkPhysicalDevice physicalDevice) {
+#if defined(VK_EXT_memory_budget) && defined(VK_KHR_get_physical_device_properties2)
+        return nullptr != vkGetPhysicalDeviceMemoryProperties2KHR && hasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+#else
+        return false;
+#endif
+    }
+
+    int countBits(VkFlags flags) {
+        auto count = 0;
+
+        for (; 0 != flags; flags &= flags - 1) {
+            count++;
+        }
+
+        return count;
+    }
+
+    // on a 1.0 instance VK_KHR_buffer_device_address needs VK_KHR_device_group for the allocation flag
+    bool queryBufferDeviceAddress(VkPhysicalDevice physicalDevice) {
+#if defined(VK_KHR_buffer_device_address) && defined(VK_KHR_device_group) && defined(VK_KHR_device_group_creation) && defined(VK_KHR_get_physical_device_properties2)
+        // both instance extensions are only loaded when createInstance() could enable them
+        if (nullptr == vkGetPhysicalDeviceFeatures2KHR || nullptr == vkEnumeratePhysicalDeviceGroupsKHR || !hasDeviceExtension(physicalDevice, VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME)
+                || !hasDeviceExtension(physicalDevice, VK_KHR_DEVICE_GROUP_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkPhysicalDeviceBufferDeviceAddressFeaturesKHR addressFeatures {};
+        addressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+
+        VkPhysicalDeviceFeatures2KHR features2 {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &addressFeatures;
+
+        vkGetPhysicalDeviceFeatures2KHR(physicalDevice, &features2);
+
+        return VK_TRUE == addressFeatures.bufferDeviceAddress;
+#else
+        return false;
+#endif
+    }
+
+    // the highest version the loader supports; 1.0 loaders lack vkEnumerateInstanceVersion
+    std::uint32_t queryInstanceVersion() {
+#if defined(VK_VERSION_1_1)
+        std::uint32_t version = 0;
+
+        if (nullptr != vkEnumerateInstanceVersion && VK_SUCCESS == vkEnumerateInstanceVersion(&version)) {
+            return version;
+        }
+#endif
+
+        return VK_MAKE_VERSION(1, 0, 0);
+    }
+
+    // whether compute shaders support every subgroup operation in operations (VkSubgroupFeatureFlags).
+    // The GL_KHR_shader_subgroup_* extensions compile to SPIR-V 1.3, which needs a Vulkan 1.1 device
+    // and instance; createInstance() asks for 1.1 wherever the loader has it
+    bool querySubgroupOperations(VkPhysicalDevice physicalDevice, const VkPhysicalDeviceProperties& properties, std::uint32_t operations) {
+#if defined(VK_VERSION_1_1) && defined(VK_KHR_get_physical_device_properties2)
+        if (nullptr == vkGetPhysicalDeviceProperties2KHR || properties.apiVersion < VK_MAKE_VERSION(1, 1, 0) || queryInstanceVersion() < VK_MAKE_VERSION(1, 1, 0)) {
+            return false;
+        }
+
+        VkPhysicalDeviceSubgroupProperties subgroupProperties {};
+        subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
+        VkPhysicalDeviceProperties2KHR properties2 {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &subgroupProperties;
+
+        vkGetPhysicalDeviceProperties2KHR(physicalDevice, &properties2);
+
+        return (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) && operations == (subgroupProperties.supportedOperations & operations);
+#else
+        return false;
+#endif
+    }
+
+    // subgroup properties are core 1.1 and need vkGetPhysicalDeviceProperties2; older drivers
+    // get the native wave width of the vendor, which is 64 on AMD and 32 nearly everywhere else.
+    std::uint32_t querySubgroupSize(VkPhysicalDevice physicalDevice, const VkPhysicalDeviceProperties& properties) {
+#if defined(VK_KHR_get_physical_device_properties2)
+        if (nullptr != vkGetPhysicalDeviceProperties2KHR && properties.apiVersion >= VK_MAKE_VERSION(1, 1, 0)) {
+            VkPhysicalDeviceSubgroupProperties subgroupProperties {};
+            subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
+            VkPhysicalDeviceProperties2KHR properties2 {};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &subgroupProperties;
+
+            vkGetPhysicalDeviceProperties2KHR(physicalDevice, &properties2);
+
+            if (0 != subgroupProperties.subgroupSize) {
+                return subgroupProperties.subgroupSize;
+            }
+        }
+#endif
+
+        return 0x1002 == properties.vendorID ? 64 : 32;
+    }
+}
+
+VkInstance context::createInstance() {
+    if (VK_SUCCESS != volkInitialize()) {
+        throw std::runtime_error("Volk could not be initialized!");
+    }
+
+    auto instanceLayers = std::vector<const char *> ();
+    auto instanceExtensions = std::vector<const char *> ();
+
+    // validation is only available where the SDK is installed; CI machines running
+    // lavapipe or SwiftShader usually have neither the layer nor the debug extension.
+    if (hasInstanceLayer("VK_LAYER_LUNARG_standard_validation")) {
+        instanceLayers.push_back("VK_LAYER_LUNARG_standard_validation");
+    }
+
+    if (hasInstanceExtension(VK_EXT_DEBUG_REPORT_EXTENSION_NAME)) {
+        instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+    }
+
+    if (hasInstanceExtension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+        instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+
+#if defined(VK_KHR_external_memory_capabilities)
+    // needed by the device-level VK_KHR_external_memory that host pointer imports build on
+    if (hasInstanceExtension(VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME)) {
+        instanceExtensions.push_back(VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME);
+    }
+#endif
+
+#if defined(VK_KHR_device_group_creation)
+    // the device-level VK_KHR_device_group, and with it buffer device addresses, depends on this
+    if (hasInstanceExtension(VK_KHR_DEVICE_GROUP_CREATION_EXTENSION_NAME)) {
+        instanceExtensions.push_back(VK_KHR_DEVICE_GROUP_CREATION_EXTENSION_NAME);
+    }
+#endif
+    
+    VkApplicationInfo appCI {};
+    appCI.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    // 1.1 where the loader has it, for subgroup operations; everything else only needs 1.0
+    appCI.apiVersion = queryInstanceVersion() >= VK_MAKE_VERSION(1, 1, 0) ? VK_MAKE_VERSION(1, 1, 0) : VK_MAKE_VERSION(1, 0, 2);
+    appCI.applicationVersion = 1;
+    appCI.pApplicationName = "Vulkan Compute Test";
+    appCI.pEngineName = "Vulkan Compute Test";
+    appCI.engineVersion = 1;
+
+    VkInstanceCreateInfo instanceCI {};
+    instanceCI.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceCI.pApplicationInfo = &appCI;
+    instanceCI.enabledLayerCount = instanceLayers.size();
+    instanceCI.ppEnabledLayerNames = instanceLayers.data();
+    instanceCI.enabledExtensionCount = instanceExtensions.size();
+    instanceCI.ppEnabledExtensionNames = instanceExtensions.data();
+
+    VkInstance instance = VK_NULL_HANDLE;
+    vkAssert(vkCreateInstance(&instanceCI, nullptr, &instance));
+    volkLoadInstance(instance);
+
+    return instance;
+}
+
+std::vector<VkPhysicalDevice> context::getPhysicalDevices(VkInstance instance) {
+    std::uint32_t nGPUs = 0;
+    vkAssert(vkEnumeratePhysicalDevices(instance, &nGPUs, nullptr));
+    auto gpus = std::vector<VkPhysicalDevice> (nGPUs);
+    vkAssert(vkEnumeratePhysicalDevices(instance, &nGPUs, gpus.data()));
+
+    return gpus;
+}
+
+context::context() {
+    instance = createInstance();
+    ownsInstance = true;
+
+    auto gpus = getPhysicalDevices(instance);
+
+    if (gpus.empty()) {
+        throw std::runtime_error("No Vulkan devices found!");
+    }
+
+    std::uint32_t selectedGPU = 0;
+    for (std::uint32_t i = 0; i < gpus.size(); i++) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(gpus[i], &properties);
+
+        if (VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU == properties.deviceType) {
+            selectedGPU = i;
+        }
+    }
+
+    init(gpus[selectedGPU]);
+}
+
+context::context(VkInstance instance, VkPhysicalDevice physicalDevice) {
+    this->instance = instance;
+    this->ownsInstance = false;
+
+    init(physicalDevice);
+}
+
+void context::init(VkPhysicalDevice physicalDevice) {
+    auto deviceExtensions = std::vector<const char *> ();
+
+    this->physicalDevice = physicalDevice;
+
+    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    subgroupSize = querySubgroupSize(physicalDevice, physicalDeviceProperties);
+#if defined(VK_VERSION_1_1)
+    subgroupArithmetic = querySubgroupOperations(physicalDevice, physicalDeviceProperties, VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+    subgroupBallot = querySubgroupOperations(physicalDevice, physicalDeviceProperties, VK_SUBGROUP_FEATURE_BALLOT_BIT);
+#else
+    subgroupArithmetic = false;
+    subgroupBallot = false;
+#endif
+    maxPushDescriptors = queryMaxPushDescriptors(physicalDevice);
+
+#if defined(VK_KHR_push_descriptor)
+    if (0 != maxPushDescriptors) {
+        deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    }
+#endif
+
+    bufferDeviceAddress = queryBufferDeviceAddress(physicalDevice);
+    minImportedHostPointerAlignment = queryMinImportedHostPointerAlignment(physicalDevice);
+
+#if defined(VK_EXT_external_memory_host)
+    if (0 != minImportedHostPointerAlignment) {
+        deviceExtensions.push_back(VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME);
+        deviceExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+    }
+#endif
+
+    memoryBudget = queryMemoryBudget(physicalDevice);
+
+#if defined(VK_EXT_memory_budget)
+    if (memoryBudget) {
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+#endif
+
+    std::uint32_t nQueueFamilies = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &nQueueFamilies, nullptr);
+    auto familyProperties = std::make_unique<VkQueueFamilyProperties[]> (nQueueFamilies);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &nQueueFamilies, familyProperties.get());
+
+    queueFamilyProperties = std::vector<VkQueueFamilyProperties> (familyProperties.get(), familyProperties.get() + nQueueFamilies);
+
+    computeQueueFamilyIds = std::vector<std::uint32_t>();
+    transferQueueFamilyIds = std::vector<std::uint32_t>();
+
+    for (std::uint32_t i = 0; i < nQueueFamilies; i++) {
+        auto flags = familyProperties[i].queueFlags;
+
+        if (0 == familyProperties[i].queueCount) {
+            continue;
+        }
+
+        if (flags & VK_QUEUE_COMPUTE_BIT) {
+            computeQueueFamilyIds.push_back(i);
+        } else if (0 == (flags & VK_QUEUE_GRAPHICS_BIT) && (flags & VK_QUEUE_TRANSFER_BIT)) {
+            // transfer-only families are the copy engines that run alongside compute
+            transferQueueFamilyIds.push_back(i);
+        }
+    }
+
+    if (computeQueueFamilyIds.empty()) {
+        throw std::runtime_error("GPU does not support any Compute Queues!");
+    }
+
+    // every queue of every compute and transfer-only family is created with equal priority
+    queueFamilyIds = computeQueueFamilyIds;
+    queueFamilyIds.insert(queueFamilyIds.end(), transferQueueFamilyIds.begin(), transferQueueFamilyIds.end());
+
+    auto queueCIs = std::vector<VkDeviceQueueCreateInfo>();
+    auto queuePriorities = std::vector<float> ();
+
+    for (auto familyId : queueFamilyIds) {
+        queuePriorities.resize(std::max<std::size_t> (queuePriorities.size(), familyProperties[familyId].queueCount), 1.0F);
+    }
+
+    for (auto familyId : queueFamilyIds) {
+        VkDeviceQueueCreateInfo queueCI {};
+        queueCI.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCI.queueFamilyIndex = familyId;
+        queueCI.queueCount = familyProperties[familyId].queueCount;
+        queueCI.pQueuePriorities = queuePriorities.data();
+
+        queueCIs.push_back(queueCI);
+    }
+
+    VkDeviceCreateInfo deviceCI {};
+    deviceCI.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceCI.queueCreateInfoCount = queueCIs.size();
+    deviceCI.pQueueCreateInfos = queueCIs.data();
+    deviceCI.enabledExtensionCount = deviceExtensions.size();
+    deviceCI.ppEnabledExtensionNames = deviceExtensions.data();
+
+    VkFlags allocateFlags = 0;
+
+#if defined(VK_KHR_buffer_device_address) && defined(VK_KHR_device_group)
+    VkPhysicalDeviceBufferDeviceAddressFeaturesKHR addressFeatures {};
+    addressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+    addressFeatures.bufferDeviceAddress = VK_TRUE;
+
+    if (bufferDeviceAddress) {
+        deviceExtensions.push_back(VK_KHR_DEVICE_GROUP_EXTENSION_NAME);
+        deviceExtensions.push_back(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
+        deviceCI.enabledExtensionCount = deviceExtensions.size();
+        deviceCI.ppEnabledExtensionNames = deviceExtensions.data();
+        deviceCI.pNext = &addressFeatures;
+
+        // any arena block may back a buffer whose address is taken
+        allocateFlags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+    }
+#endif
+
+    vkAssert(vkCreateDevice(physicalDevice, &deviceCI, nullptr, &device));
+
+    // device functions come straight from the driver, bypassing the loader trampolines, and stay
+    // correct however many contexts the process creates
+    volkLoadDeviceTable(&vk, device);
+
+    // the device table of this volk version predates VK_KHR_buffer_device_address
+    getBufferDeviceAddress = bufferDeviceAddress ? vkGetDeviceProcAddr(device, "vkGetBufferDeviceAddressKHR") : nullptr;
+
+    arena = std::make_unique<memory_arena> (device, vk, memoryProperties, physicalDeviceProperties.limits, memory_arena::DEFAULT_BLOCK_SIZE, allocateFlags);
+}
+
+context::~context() {
+    arena.reset();
+    vk.vkDestroyDevice(device, nullptr);
+
+    if (ownsInstance) {
+        vkDestroyInstance(instance, nullptr);
+    }
+}
+
+bool context::isUnifiedMemory() const {
+    return VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU == physicalDeviceProperties.deviceType
+            || VK_PHYSICAL_DEVICE_TYPE_CPU == physicalDeviceProperties.deviceType;
+}
+
+memory_allocation context::bindMemory(VkBuffer buffer, VkMemoryPropertyFlags properties) {
+    return bindMemory(buffer, memory_policy {properties, 0, 0});
+}
+
+memory_allocation context::bindMemory(VkBuffer buffer, const memory_policy& policy) {
+    VkMemoryRequirements memReqs;
+    vk.vkGetBufferMemoryRequirements(device, buffer, &memReqs);
+
+    auto memoryTypeIndex = getMemoryTypeIndex(memReqs.memoryTypeBits, policy, memReqs.size);
+    auto allocation = arena->allocate(memReqs, memoryTypeIndex, resource_kind::linear);
+
+    vkAssert(vk.vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset));
+
+    return allocation;
+}
+
+void context::freeMemory(const memory_allocation& allocation) {
+    arena->free(allocation);
+}
+
+void context::flushMemory(const memory_allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const {
+    arena->flush(allocation, offset, size);
+}
+
+void context::invalidateMemory(const memory_allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const {
+    arena->invalidate(allocation, offset, size);
+}
+
+void context::shareAcrossQueueFamilies(VkBufferCreateInfo& bufferCI) const {
+    if (queueFamilyIds.size() > 1) {
+        bufferCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferCI.queueFamilyIndexCount = queueFamilyIds.size();
+        bufferCI.pQueueFamilyIndices = queueFamilyIds.data();
+    }
+}
+
+std::uint32_t context::getPreferredWorkgroupSize() const {
+    const auto& limits = physicalDeviceProperties.limits;
+    std::uint32_t workgroupSize = PREFERRED_WORKGROUP_INVOCATIONS;
+
+    workgroupSize = std::min(workgroupSize, limits.maxComputeWorkGroupSize[0]);
+    workgroupSize = std::min(workgroupSize, limits.maxComputeWorkGroupInvocations);
+
+    // whole subgroups only, otherwise the last one in every workgroup runs partially empty
+    if (workgroupSize >= subgroupSize) {
+        workgroupSize -= workgroupSize % subgroupSize;
+    }
+
+    return std::max(workgroupSize, 1U);
+}
+
+std::uint32_t context::getGroupCount(std::uint64_t invocations, std::uint32_t workgroupSize) const {
+    auto groupCount = (invocations + workgroupSize - 1) / workgroupSize;
+
+    // kernels loop over the remainder with a grid stride, so the x dimension can simply be capped
+    return static_cast<std::uint32_t> (std::min<std::uint64_t> (groupCount, physicalDeviceProperties.limits.maxComputeWorkGroupCount[0]));
+}
+
+std::uint32_t context::getMemoryTypeIndex(std::uint32_t typeBits, unsigned int requirementsMask) const {
+    return getMemoryTypeIndex(typeBits, memory_policy {requirementsMask, 0, 0});
+}
+
+std::uint32_t context::getMemoryTypeIndex(std::uint32_t typeBits, const memory_policy& policy, VkDeviceSize size) const {
+    auto headroom = getHeapHeadroom();
+    auto mentioned = policy.required | policy.preferred | policy.forbidden;
+    auto bestIndex = memoryProperties.memoryTypeCount;
+    // fits the heap's budget, preferred flags present, unmentioned flags absent, heap budget left
+    auto bestScore = std::make_tuple(false, 0, 0, VkDeviceSize(0));
+
+    for (std::uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        auto flags = memoryProperties.memoryTypes[i].propertyFlags;
+
+        if (0 == (typeBits & (1u << i)) || policy.required != (flags & policy.required) || 0 != (flags & policy.forbidden)) {
+            continue;
+        }
+
+        auto heapIndex = memoryProperties.memoryTypes[i].heapIndex;
+        auto heapHeadroom = headroom[heapIndex];
+        // a request served from a free range costs the heap nothing, one needing a block costs the block
+        auto newBytes = 0 == size || nullptr == arena ? size : arena->getNewBlockBytes(size, i);
+        auto preferred = policy.preferred;
+
+        // a large upload would crowd everything else out of a small BAR window, and may not fit at all
+        if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && size > memoryProperties.memoryHeaps[heapIndex].size / HOST_VISIBLE_DEVICE_LOCAL_DIVISOR) {
+            preferred &= ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        }
+
+        auto score = std::make_tuple(newBytes <= heapHeadroom, countBits(flags & preferred), -countBits(flags & ~mentioned), heapHeadroom);
+
+        if (bestIndex == memoryProperties.memoryTypeCount || score > bestScore) {
+            bestIndex = i;
+            bestScore = score;
+        }
+    }
+
+    if (bestIndex == memoryProperties.memoryTypeCount) {
+        throw std::runtime_error("No MemoryType exists with the requested features!");
+    }
+
+    return bestIndex;
+}
+
+std::vector<VkDeviceSize> context::getHeapHeadroom() const {
+    auto headroom = std::vector<VkDeviceSize> (memoryProperties.memoryHeapCount);
+    // without budgets the arena's own blocks are the only usage known
+    auto used = nullptr != arena ? arena->getHeapBlockBytes() : std::vector<VkDeviceSize> (memoryProperties.memoryHeapCount);
+
+    for (std::uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        auto heapSize = memoryProperties.memoryHeaps[i].size;
+
+        headroom[i] = heapSize > used[i] ? heapSize - used[i] : 0;
+    }
+
+#if defined(VK_EXT_memory_budget) && defined(VK_KHR_get_physical_device_properties2)
+    if (memoryBudget) {
+        // budgets move with every allocation in the system, this process's or not, so ask each time
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties {};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2KHR properties2 {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties2.pNext = &budgetProperties;
+
+        vkGetPhysicalDeviceMemoryProperties2KHR(physicalDevice, &properties2);
+
+        for (std::uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            auto budget = budgetProperties.heapBudget[i];
+            auto usage = budgetProperties.heapUsage[i];
+
+            headroom[i] = budget > usage ? budget - usage : 0;
+        }
+    }
+#endif
+
+    return headroom;
+}
+
+void context::enableDeviceAddress(VkBufferCreateInfo& bufferCI) const {
+#if defined(VK_KHR_buffer_device_address)
+    if (bufferDeviceAddress) {
+        bufferCI.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
+    }
+#endif
+}
+
+std::uint64_t context::getDeviceAddress(VkBuffer buffer) const {
+#if defined(VK_KHR_buffer_device_address)
+    if (nullptr != getBufferDeviceAddress) {
+        VkBufferDeviceAddressInfoKHR addressInfo {};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR;
+        addressInfo.buffer = buffer;
+
+        return reinterpret_cast<PFN_vkGetBufferDeviceAddressKHR> (getBufferDeviceAddress)(device, &addressInfo);
+    }
+#endif
+
+    throw std::runtime_error("Buffer device addresses are not enabled!");
+}
@@ -0,0 +1,221 @@
+#include "descriptor_cache.hpp"
+
+#include "util.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    void hashCombine(std::size_t& seed, std::size_t value) {
+        seed ^= value + 0x9E3779B9 + (seed << 6) + (seed >> 2);
+    }
+
+    std::vector<VkWriteDescriptorSet> makeDescriptorWrites(VkDescriptorSet descriptorSet, const std::vector<descriptor_binding>& bindings, std::vector<VkDescriptorBufferInfo>& descriptorBufferInfos) {
+        auto descriptorSetWrites = std::vector<VkWriteDescriptorSet> ();
+
+        // the writes point into this vector, so it must not reallocate
+        descriptorBufferInfos.reserve(bindings.size());
+
+        for (std::uint32_t i = 0; i < bindings.size(); i++) {
+            VkDescriptorBufferInfo bufferInfo {};
+            bufferInfo.buffer = bindings[i].buffer;
+            bufferInfo.offset = bindings[i].offset;
+            bufferInfo.range = bindings[i].range;
+
+            descriptorBufferInfos.push_back(bufferInfo);
+
+            VkWriteDescriptorSet write {};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.descriptorCount = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.pBufferInfo = &descriptorBufferInfos.back();
+            write.dstBinding = i;
+            write.dstSet = descriptorSet;
+
+            descriptorSetWrites.push_back(write);
+        }
+
+        return descriptorSetWrites;
+    }
+}
+
+bool descriptor_binding::operator==(const descriptor_binding& other) const {
+    return buffer == other.buffer && offset == other.offset && range == other.range;
+}
+
+void writeDescriptorSet(const context& ctx, VkDescriptorSet descriptorSet, const std::vector<descriptor_binding>& bindings) {
+    auto descriptorBufferInfos = std::vector<VkDescriptorBufferInfo> ();
+    auto descriptorSetWrites = makeDescriptorWrites(descriptorSet, bindings, descriptorBufferInfos);
+
+    ctx.vk.vkUpdateDescriptorSets(ctx.device, descriptorSetWrites.size(), descriptorSetWrites.data(), 0, nullptr);
+}
+
+void pushDescriptorSet(const context& ctx, VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const std::vector<descriptor_binding>& bindings) {
+#if defined(VK_KHR_push_descriptor)
+    auto descriptorBufferInfos = std::vector<VkDescriptorBufferInfo> ();
+    auto descriptorSetWrites = makeDescriptorWrites(VK_NULL_HANDLE, bindings, descriptorBufferInfos);
+
+    ctx.vk.vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, descriptorSetWrites.size(), descriptorSetWrites.data());
+#else
+    throw std::runtime_error("Built without VK_KHR_push_descriptor!");
+#endif
+}
+
+descriptor_allocator::descriptor_allocator(context& ctx) : ctx(ctx), current(0) {
+}
+
+descriptor_allocator::~descriptor_allocator() {
+    for (const auto& p : pools) {
+        ctx.vk.vkDestroyDescriptorPool(ctx.device, p.descriptorPool, nullptr);
+    }
+}
+
+VkDescriptorSet descriptor_allocator::allocate(VkDescriptorSetLayout layout, std::uint32_t storageBufferCount) {
+    // sets only ever hold storage buffers and are never freed one by one, so counting what is
+    // left tells exactly when a pool is exhausted; there is no fragmentation to run into
+    while (current < pools.size() && (0 == pools[current].setsLeft || pools[current].storageBuffersLeft < storageBufferCount)) {
+        current++;
+    }
+
+    if (current == pools.size()) {
+        pools.push_back(createPool(storageBufferCount));
+    }
+
+    auto& p = pools[current];
+
+    VkDescriptorSetAllocateInfo descriptorSetAI {};
+    descriptorSetAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAI.descriptorPool = p.descriptorPool;
+    descriptorSetAI.descriptorSetCount = 1;
+    descriptorSetAI.pSetLayouts = &layout;
+
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    vkAssert(ctx.vk.vkAllocateDescriptorSets(ctx.device, &descriptorSetAI, &descriptorSet));
+
+    p.setsLeft--;
+    p.storageBuffersLeft -= storageBufferCount;
+
+    return descriptorSet;
+}
+
+void descriptor_allocator::reset() {
+    for (auto& p : pools) {
+        vkAssert(ctx.vk.vkResetDescriptorPool(ctx.device, p.descriptorPool, 0));
+
+        p.setsLeft = SETS_PER_POOL;
+        p.storageBuffersLeft = p.storageBufferCapacity;
+    }
+
+    current = 0;
+}
+
+std::size_t descriptor_allocator::getPoolCount() const {
+    return pools.size();
+}
+
+descriptor_allocator::pool descriptor_allocator::createPool(std::uint32_t storageBufferCount) {
+    // a layout wider than a whole pool gets a pool of its own size
+    std::uint32_t defaultCapacity = STORAGE_BUFFERS_PER_POOL;
+
+    auto p = pool();
+    p.setsLeft = SETS_PER_POOL;
+    p.storageBufferCapacity = std::max(defaultCapacity, storageBufferCount);
+    p.storageBuffersLeft = p.storageBufferCapacity;
+
+    VkDescriptorPoolSize poolSize {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = p.storageBuffersLeft;
+
+    VkDescriptorPoolCreateInfo descriptorPoolCI {};
+    descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCI.maxSets = p.setsLeft;
+    descriptorPoolCI.poolSizeCount = 1;
+    descriptorPoolCI.pPoolSizes = &poolSize;
+
+    vkAssert(ctx.vk.vkCreateDescriptorPool(ctx.device, &descriptorPoolCI, nullptr, &p.descriptorPool));
+
+    return p;
+}
+
+bool descriptor_cache::key::operator==(const key& other) const {
+    return layout == other.layout && bindings == other.bindings;
+}
+
+std::size_t descriptor_cache::key_hash::operator()(const key& k) const {
+    auto seed = std::hash<VkDescriptorSetLayout> ()(k.layout);
+
+    for (const auto& binding : k.bindings) {
+        hashCombine(seed, std::hash<VkBuffer> ()(binding.buffer));
+        hashCombine(seed, std::hash<VkDeviceSize> ()(binding.offset));
+        hashCombine(seed, std::hash<VkDeviceSize> ()(binding.range));
+    }
+
+    return seed;
+}
+
+descriptor_cache::descriptor_cache(context& ctx) : ctx(ctx), allocator(ctx), allocatedCount(0), hitCount(0), missCount(0) {
+}
+
+VkDescriptorSet descriptor_cache::get(VkDescriptorSetLayout layout, const std::vector<descriptor_binding>& bindings) {
+    auto k = key {layout, bindings};
+    auto it = sets.find(k);
+
+    if (it != sets.end()) {
+        hitCount++;
+        return it->second;
+    }
+
+    missCount++;
+
+    auto descriptorSet = allocator.allocate(layout, bindings.size());
+    allocatedCount++;
+
+    writeDescriptorSet(ctx, descriptorSet, bindings);
+
+    sets.emplace(std::move(k), descriptorSet);
+
+    return descriptorSet;
+}
+
+bool descriptor_cache::contains(VkDescriptorSetLayout layout, const std::vector<descriptor_binding>& bindings) const {
+    return sets.find(key {layout, bindings}) != sets.end();
+}
+
+void descriptor_cache::invalidate(VkBuffer buffer) {
+    for (auto it = sets.begin(); it != sets.end();) {
+        auto references = std::any_of(it->first.bindings.begin(), it->first.bindings.end(), [buffer](const descriptor_binding& binding) {
+            return binding.buffer == buffer;
+        });
+
+        it = references ? sets.erase(it) : std::next(it);
+    }
+}
+
+void descriptor_cache::clear() {
+    sets.clear();
+    allocator.reset();
+    allocatedCount = 0;
+}
+
+std::size_t descriptor_cache::size() const {
+    return sets.size();
+}
+
+std::size_t descriptor_cache::getAllocatedCount() const {
+    return allocatedCount;
+}
+
+std::size_t descriptor_cache::getPoolCount() const {
+    return allocator.getPoolCount();
+}
+
+std::uint64_t descriptor_cache::getHitCount() const {
+    return hitCount;
+}
+
+std::uint64_t descriptor_cache::getMissCount() const {
+    return missCount;
+}
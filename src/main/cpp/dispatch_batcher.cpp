@@ -0,0 +1,139 @@
+#include "dispatch_batcher.hpp"
+
+#include <algorithm>
+
+batched_job::batched_job() : batcher(nullptr), batchId(0) {}
+
+batched_job::batched_job(dispatch_batcher * batcher, std::uint64_t batchId) : batcher(batcher), batchId(batchId) {}
+
+bool batched_job::isReady() const {
+    return nullptr == batcher || batcher->isReady(batchId);
+}
+
+void batched_job::wait() const {
+    if (nullptr != batcher) {
+        batcher->wait(batchId);
+    }
+}
+
+dispatch_batcher::dispatch_batcher(context& ctx, submission_queue& queue, std::uint32_t maxDispatches, std::chrono::microseconds maxLatency)
+        : ctx(ctx), queue(queue), maxDispatches(maxDispatches), maxLatency(maxLatency) {
+    openDispatchCount = 0;
+    openBatchId = 0;
+    firstSubmittedId = 0;
+}
+
+dispatch_batcher::~dispatch_batcher() {
+    flush();
+
+    for (const auto& future : submitted) {
+        future.wait();
+    }
+}
+
+batched_job dispatch_batcher::dispatch(compute_kernel& kernel, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) {
+    if (std::find(openKernels.begin(), openKernels.end(), &kernel) == openKernels.end()) {
+        openKernels.push_back(&kernel);
+    }
+
+    return record([&kernel, buffers, groupCount, pushConstants](VkCommandBuffer commandBuffer) {
+        kernel.record(commandBuffer, buffers, groupCount, pushConstants);
+    });
+}
+
+batched_job dispatch_batcher::record(const std::function<void(VkCommandBuffer)>& recorder) {
+    poll();
+
+    if (openRecorders.empty()) {
+        openSince = std::chrono::steady_clock::now();
+    }
+
+    openRecorders.push_back(recorder);
+    openDispatchCount++;
+
+    auto job = batched_job(this, openBatchId);
+
+    if (openDispatchCount >= maxDispatches) {
+        flush();
+    }
+
+    return job;
+}
+
+void dispatch_batcher::barrier() {
+    if (openRecorders.empty()) {
+        // batches are separate submissions on one queue, which the next one's barriers already order against
+        return;
+    }
+
+    openRecorders.push_back([this](VkCommandBuffer commandBuffer) {
+        VkMemoryBarrier barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    });
+}
+
+void dispatch_batcher::poll() {
+    if (!openRecorders.empty() && std::chrono::steady_clock::now() - openSince >= maxLatency) {
+        flush();
+    }
+
+    while (!submitted.empty() && submitted.front().isReady()) {
+        submitted.pop_front();
+        firstSubmittedId++;
+    }
+}
+
+void dispatch_batcher::flush() {
+    if (openRecorders.empty()) {
+        return;
+    }
+
+    // the batch binds descriptor sets from these kernels' caches, which must not be flushed under it
+    for (auto kernel : openKernels) {
+        kernel->beginRecording();
+    }
+
+    auto future = queue.submit([this](VkCommandBuffer commandBuffer) {
+        for (const auto& recorder : openRecorders) {
+            recorder(commandBuffer);
+        }
+    });
+
+    for (auto kernel : openKernels) {
+        kernel->endRecording(future);
+    }
+
+    submitted.push_back(future);
+    openRecorders.clear();
+    openKernels.clear();
+    openDispatchCount = 0;
+    openBatchId++;
+}
+
+bool dispatch_batcher::isReady(std::uint64_t batchId) {
+    poll();
+
+    if (batchId >= openBatchId) {
+        return false;
+    }
+
+    if (batchId < firstSubmittedId) {
+        return true;
+    }
+
+    return submitted[batchId - firstSubmittedId].isReady();
+}
+
+void dispatch_batcher::wait(std::uint64_t batchId) {
+    if (batchId >= openBatchId) {
+        flush();
+    }
+
+    if (batchId >= firstSubmittedId) {
+        submitted[batchId - firstSubmittedId].wait();
+    }
+}
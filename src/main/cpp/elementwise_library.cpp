@@ -0,0 +1,174 @@
+#include "elementwise_library.hpp"
+
+#include "util.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+    const auto ALL_TYPES = std::vector<element_type> {element_type::f32, element_type::i32, element_type::u32};
+
+    // macro value the template compares IN_TYPE and OUT_TYPE against
+    const char * getTemplateTypeName(element_type type) {
+        switch (type) {
+            case element_type::f32:
+                return "TYPE_F32";
+            case element_type::i32:
+                return "TYPE_I32";
+            default:
+                return "TYPE_U32";
+        }
+    }
+
+    elementwise_op makeOp(const std::string& name, std::uint32_t inputCount, std::uint32_t parameterCount, const std::string& expression, const std::vector<element_type>& types) {
+        return elementwise_op {name, inputCount, parameterCount, expression, types, false, element_type::f32};
+    }
+
+    // expression "a" does the conversion: the template casts every result to the output type
+    elementwise_op makeConversion(element_type outputType) {
+        auto types = std::vector<element_type> ();
+
+        std::copy_if(ALL_TYPES.begin(), ALL_TYPES.end(), std::back_inserter(types), [outputType](element_type type) {
+            return type != outputType;
+        });
+
+        return elementwise_op {std::string("to_") + elementwise_library::getTypeName(outputType), 1, 0, "a", types, true, outputType};
+    }
+}
+
+elementwise_library::elementwise_library(context& ctx, VkPipelineCache pipelineCache) : ctx(ctx), pipelineCache(pipelineCache), workgroupSize(ctx.getPreferredWorkgroupSize()) {
+}
+
+const std::vector<elementwise_op>& elementwise_library::getOps() {
+    // MAD is fma for floats and a * b + c for integers
+    static const auto ops = std::vector<elementwise_op> {
+        makeOp("square", 1, 0, "a * a", ALL_TYPES),
+        makeOp("scale", 1, 1, "a * p0", ALL_TYPES),
+        makeOp("add", 2, 0, "a + b", ALL_TYPES),
+        makeOp("mul", 2, 0, "a * b", ALL_TYPES),
+        makeOp("fma", 3, 0, "MAD(a, b, c)", ALL_TYPES),
+        // p0 * a + b
+        makeOp("axpy", 2, 1, "MAD(p0, a, b)", ALL_TYPES),
+        makeOp("clamp", 1, 2, "clamp(a, p0, p1)", ALL_TYPES),
+        makeOp("exp", 1, 0, "exp(a)", {element_type::f32}),
+        // 1 where a >= p0, else 0
+        makeOp("step", 1, 1, "step(p0, a)", {element_type::f32}),
+        makeConversion(element_type::f32),
+        makeConversion(element_type::i32),
+        makeConversion(element_type::u32)
+    };
+
+    return ops;
+}
+
+const elementwise_op& elementwise_library::getOp(const std::string& name) {
+    const auto& ops = getOps();
+    auto it = std::find_if(ops.begin(), ops.end(), [&name](const elementwise_op& op) {
+        return op.name == name;
+    });
+
+    if (it == ops.end()) {
+        throw std::runtime_error("Unknown element-wise operation " + name + "!");
+    }
+
+    return *it;
+}
+
+element_type elementwise_library::getOutputType(const elementwise_op& op, element_type type) {
+    return op.converts ? op.outputType : type;
+}
+
+const char * elementwise_library::getTypeName(element_type type) {
+    switch (type) {
+        case element_type::f32:
+            return "f32";
+        case element_type::i32:
+            return "i32";
+        default:
+            return "u32";
+    }
+}
+
+std::string elementwise_library::getSpvFileName(const elementwise_op& op, element_type type) {
+    return op.name + "_" + getTypeName(type) + ".comp.spv";
+}
+
+std::string elementwise_library::getCompileCommand(const elementwise_op& op, element_type type) {
+    return std::string("glslc -c src/main/glsl/elementwise.comp")
+            + " -DIN_TYPE=" + getTemplateTypeName(type)
+            + " -DOUT_TYPE=" + getTemplateTypeName(getOutputType(op, type))
+            + " -DINPUT_COUNT=" + std::to_string(op.inputCount)
+            + " '-DEXPRESSION=" + op.expression + "'"
+            + " -o " + getSpvFileName(op, type);
+}
+
+std::uint32_t elementwise_library::toParameter(float value) {
+    std::uint32_t word;
+    std::memcpy(&word, &value, sizeof(word));
+
+    return word;
+}
+
+std::uint32_t elementwise_library::toParameter(std::int32_t value) {
+    return static_cast<std::uint32_t> (value);
+}
+
+std::uint32_t elementwise_library::toParameter(std::uint32_t value) {
+    return value;
+}
+
+compute_kernel& elementwise_library::get(const std::string& name, element_type type) {
+    auto key = std::make_pair(name, type);
+    auto it = kernels.find(key);
+
+    if (it != kernels.end()) {
+        return *it->second;
+    }
+
+    const auto& op = getOp(name);
+
+    if (std::find(op.types.begin(), op.types.end(), type) == op.types.end()) {
+        throw std::runtime_error("Element-wise operation " + name + " is not defined for " + getTypeName(type) + "!");
+    }
+
+    // inputs and output, once as vectors and once as scalars; the count, then the parameters
+    auto bindingCount = 2 * (op.inputCount + 1);
+    auto pushConstantCount = 1 + MAX_PARAMETERS;
+    auto pKernel = std::make_unique<compute_kernel> (ctx, name, readFile(getSpvFileName(op, type)), bindingCount, pipelineCache, std::vector<std::uint32_t> {workgroupSize}, pushConstantCount);
+
+    return *(kernels[key] = std::move(pKernel));
+}
+
+void elementwise_library::dispatch(const std::string& name, element_type type, const std::vector<VkBuffer>& inputs, VkBuffer output, std::uint32_t count, const std::vector<std::uint32_t>& parameters) {
+    const auto& op = getOp(name);
+
+    if (inputs.size() != op.inputCount || parameters.size() != op.parameterCount) {
+        throw std::runtime_error("Element-wise operation " + name + " got the wrong number of inputs or parameters!");
+    }
+
+    auto& kernel = get(name, type);
+
+    auto operands = inputs;
+    operands.push_back(output);
+
+    auto buffers = operands;
+    buffers.insert(buffers.end(), operands.begin(), operands.end());
+
+    auto pushConstants = std::vector<std::uint32_t> {count};
+    pushConstants.insert(pushConstants.end(), parameters.begin(), parameters.end());
+    pushConstants.resize(1 + MAX_PARAMETERS, 0);
+
+    // one vec4 per invocation, and the first invocations also take one element of the tail each
+    auto invocationCount = std::max(count / 4, count % 4);
+
+    kernel.dispatch(buffers, ctx.getGroupCount(invocationCount, workgroupSize), pushConstants);
+}
+
+void elementwise_library::forget(VkBuffer buffer) {
+    for (auto& entry : kernels) {
+        entry.second->forget(buffer);
+    }
+}
@@ -0,0 +1,212 @@
+#include "gpu_profiler.hpp"
+
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <set>
+
+namespace {
+    const std::uint32_t NO_SCOPE = std::numeric_limits<std::uint32_t>::max();
+}
+
+gpu_profiler::gpu_profiler(context& ctx, std::uint32_t queueFamilyIndex, std::uint32_t queryCount) : ctx(ctx), queryCount(queryCount & ~1U) {
+    std::uint32_t nQueueFamilies = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &nQueueFamilies, nullptr);
+    auto familyProperties = std::make_unique<VkQueueFamilyProperties[]> (nQueueFamilies);
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &nQueueFamilies, familyProperties.get());
+
+    auto validBits = familyProperties[queueFamilyIndex].timestampValidBits;
+
+    timestampMask = validBits >= 64 ? std::numeric_limits<std::uint64_t>::max() : ((std::uint64_t(1) << validBits) - 1);
+    msPerTick = ctx.physicalDeviceProperties.limits.timestampPeriod / 1.0e6;
+    queryPool = VK_NULL_HANDLE;
+    observing = false;
+
+    if (0 == validBits) {
+        return;
+    }
+
+    VkQueryPoolCreateInfo queryPoolCI {};
+    queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCI.queryCount = this->queryCount;
+
+    vkAssert(ctx.vk.vkCreateQueryPool(ctx.device, &queryPoolCI, nullptr, &queryPool));
+
+    // each scope takes a (begin, end) pair of queries
+    for (std::uint32_t i = this->queryCount; i > 0; i -= 2) {
+        freeQueries.push_back(i - 2);
+    }
+}
+
+gpu_profiler::~gpu_profiler() {
+    for (const auto& b : batches) {
+        b.completion.wait();
+    }
+
+    if (VK_NULL_HANDLE != queryPool) {
+        ctx.vk.vkDestroyQueryPool(ctx.device, queryPool, nullptr);
+    }
+}
+
+bool gpu_profiler::isSupported() const {
+    return VK_NULL_HANDLE != queryPool;
+}
+
+std::uint32_t gpu_profiler::begin(VkCommandBuffer commandBuffer, const std::string& label) {
+    if (!isSupported()) {
+        return NO_SCOPE;
+    }
+
+    if (freeQueries.empty()) {
+        collect();
+
+        if (freeQueries.empty()) {
+            // dropping a sample is better than stalling the caller
+            return NO_SCOPE;
+        }
+    }
+
+    auto query = freeQueries.back();
+    freeQueries.pop_back();
+
+    ctx.vk.vkCmdResetQueryPool(commandBuffer, queryPool, query, 2);
+    ctx.vk.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, query);
+
+    openScopes.push_back(scope {label, query});
+
+    return query;
+}
+
+void gpu_profiler::end(VkCommandBuffer commandBuffer, std::uint32_t scope) {
+    if (NO_SCOPE == scope) {
+        return;
+    }
+
+    ctx.vk.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, scope + 1);
+}
+
+void gpu_profiler::endBatch(const job_future& completion, std::chrono::steady_clock::time_point submitTime) {
+    if (openScopes.empty()) {
+        return;
+    }
+
+    batches.push_back(batch {std::move(openScopes), completion, submitTime, submitTime, false});
+    openScopes.clear();
+}
+
+void gpu_profiler::observeCompletions() {
+    // polling a batch's future may make its queue report completions again
+    if (observing) {
+        return;
+    }
+
+    observing = true;
+
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto& b : batches) {
+        if (!b.completed && b.completion.isReady()) {
+            b.completionTime = now;
+            b.completed = true;
+        }
+    }
+
+    observing = false;
+}
+
+void gpu_profiler::collect() {
+    observeCompletions();
+
+    while (!batches.empty() && batches.front().completed) {
+        auto& b = batches.front();
+        auto hostMs = std::chrono::duration<double, std::milli> (b.completionTime - b.submitTime).count();
+        auto labels = std::set<std::string>();
+
+        for (const auto& s : b.scopes) {
+            std::uint64_t ticks[2] = {0, 0};
+
+            vkAssert(ctx.vk.vkGetQueryPoolResults(ctx.device, queryPool, s.query, 2, sizeof(ticks), ticks, sizeof(std::uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+            auto elapsed = ((ticks[1] & timestampMask) - (ticks[0] & timestampMask)) & timestampMask;
+
+            deviceSamples[s.label].push_back(elapsed * msPerTick);
+            freeQueries.push_back(s.query);
+            labels.insert(s.label);
+        }
+
+        for (const auto& label : labels) {
+            hostSamples[label].push_back(hostMs);
+        }
+
+        batches.pop_front();
+    }
+}
+
+gpu_profiler::statistics gpu_profiler::getDeviceStatistics(const std::string& label) const {
+    auto it = deviceSamples.find(label);
+
+    return summarize(it == deviceSamples.end() ? std::vector<double> () : it->second);
+}
+
+gpu_profiler::statistics gpu_profiler::getHostStatistics(const std::string& label) const {
+    auto it = hostSamples.find(label);
+
+    return summarize(it == hostSamples.end() ? std::vector<double> () : it->second);
+}
+
+void gpu_profiler::report(std::ostream& out) const {
+    out << std::left << std::setw(20) << "label"
+            << std::right << std::setw(8) << "count"
+            << std::setw(12) << "gpu min"
+            << std::setw(12) << "gpu mean"
+            << std::setw(12) << "gpu p99"
+            << std::setw(12) << "host min"
+            << std::setw(12) << "host mean"
+            << std::setw(12) << "host p99" << "  (ms)\n";
+
+    for (const auto& entry : deviceSamples) {
+        auto device = getDeviceStatistics(entry.first);
+        auto host = getHostStatistics(entry.first);
+
+        out << std::left << std::setw(20) << entry.first
+                << std::right << std::setw(8) << device.count
+                << std::fixed << std::setprecision(4)
+                << std::setw(12) << device.minMs
+                << std::setw(12) << device.meanMs
+                << std::setw(12) << device.p99Ms
+                << std::setw(12) << host.minMs
+                << std::setw(12) << host.meanMs
+                << std::setw(12) << host.p99Ms << "\n";
+    }
+
+    out.unsetf(std::ios::floatfield);
+}
+
+gpu_profiler::statistics gpu_profiler::summarize(std::vector<double> samples) {
+    auto stats = statistics {samples.size(), 0.0, 0.0, 0.0};
+
+    if (samples.empty()) {
+        return stats;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+
+    for (auto sample : samples) {
+        sum += sample;
+    }
+
+    auto p99Index = static_cast<std::size_t> (std::ceil(0.99 * samples.size())) - 1;
+
+    stats.minMs = samples.front();
+    stats.meanMs = sum / samples.size();
+    stats.p99Ms = samples[p99Index];
+
+    return stats;
+}
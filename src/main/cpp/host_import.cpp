@@ -0,0 +1,160 @@
+#include "host_import.hpp"
+
+#include "util.hpp"
+
+#include <cstdint>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    VkBuffer createImportableBuffer(const context& ctx, VkDeviceSize size, VkBufferUsageFlags usage) {
+        VkBuffer buffer = VK_NULL_HANDLE;
+
+#if defined(VK_EXT_external_memory_host)
+        VkExternalMemoryBufferCreateInfoKHR externalCI {};
+        externalCI.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+        externalCI.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+        VkBufferCreateInfo bufferCI {};
+        bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCI.pNext = &externalCI;
+        bufferCI.usage = usage;
+        bufferCI.size = size;
+
+        ctx.shareAcrossQueueFamilies(bufferCI);
+
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &buffer));
+#endif
+
+        return buffer;
+    }
+}
+
+bool host_import::isSupported(const context& ctx, const void * pHost, VkDeviceSize size) {
+    auto alignment = ctx.minImportedHostPointerAlignment;
+
+    return 0 != alignment && 0 == reinterpret_cast<std::uintptr_t> (pHost) % alignment && 0 == size % alignment;
+}
+
+host_import::host_import(context& ctx, void * pHost, VkDeviceSize size) : ctx(ctx), size(size), memory(VK_NULL_HANDLE), memoryTypeIndex(0), pMapped(nullptr) {
+#if defined(VK_EXT_external_memory_host)
+    if (!isSupported(ctx, pHost, size)) {
+        throw std::runtime_error("Host memory cannot be imported!");
+    }
+
+    VkMemoryHostPointerPropertiesEXT hostPointerProperties {};
+    hostPointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+
+    vkAssert(ctx.vk.vkGetMemoryHostPointerPropertiesEXT(ctx.device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pHost, &hostPointerProperties));
+
+    if (0 == hostPointerProperties.memoryTypeBits) {
+        throw std::runtime_error("No memory type can import this host memory!");
+    }
+
+    // the type must also suit the storage buffers createBuffer() binds, which a small probe buffer tells
+    VkMemoryRequirements memReqs;
+    auto probeBuffer = createImportableBuffer(ctx, ctx.minImportedHostPointerAlignment, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    ctx.vk.vkGetBufferMemoryRequirements(ctx.device, probeBuffer, &memReqs);
+    ctx.vk.vkDestroyBuffer(ctx.device, probeBuffer, nullptr);
+
+    auto typeBits = hostPointerProperties.memoryTypeBits & memReqs.memoryTypeBits;
+
+    if (0 == typeBits) {
+        throw std::runtime_error("No memory type can import this host memory for storage buffers!");
+    }
+
+    memoryTypeIndex = ctx.getMemoryTypeIndex(typeBits, memory_policy {0, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0});
+
+    VkImportMemoryHostPointerInfoEXT importInfo {};
+    importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    importInfo.pHostPointer = pHost;
+
+    VkMemoryAllocateInfo allocInfo {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = &importInfo;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    vkAssert(ctx.vk.vkAllocateMemory(ctx.device, &allocInfo, nullptr, &memory));
+
+    auto flags = ctx.memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+    if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && 0 == (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        auto result = ctx.vk.vkMapMemory(ctx.device, memory, 0, VK_WHOLE_SIZE, 0, &pMapped);
+
+        if (VK_SUCCESS != result) {
+            ctx.vk.vkFreeMemory(ctx.device, memory, nullptr);
+            vkAssert(result);
+        }
+    }
+#else
+    throw std::runtime_error("Built without VK_EXT_external_memory_host!");
+#endif
+}
+
+host_import::~host_import() {
+    if (nullptr != pMapped) {
+        ctx.vk.vkUnmapMemory(ctx.device, memory);
+    }
+
+    ctx.vk.vkFreeMemory(ctx.device, memory, nullptr);
+}
+
+VkBuffer host_import::createBuffer(VkDeviceSize offset, VkDeviceSize size, VkBufferUsageFlags usage) const {
+    if (offset + size > this->size) {
+        throw std::runtime_error("Buffer exceeds the imported host memory!");
+    }
+
+    auto buffer = createImportableBuffer(ctx, size, usage);
+
+#if defined(VK_EXT_external_memory_host)
+    VkMemoryRequirements memReqs;
+    ctx.vk.vkGetBufferMemoryRequirements(ctx.device, buffer, &memReqs);
+
+    if (0 != offset % memReqs.alignment || 0 == (memReqs.memoryTypeBits & (1u << memoryTypeIndex))) {
+        ctx.vk.vkDestroyBuffer(ctx.device, buffer, nullptr);
+        throw std::runtime_error("Buffer cannot be bound to the imported host memory!");
+    }
+
+    vkAssert(ctx.vk.vkBindBufferMemory(ctx.device, buffer, memory, offset));
+#endif
+
+    return buffer;
+}
+
+void host_import::flush(VkDeviceSize offset, VkDeviceSize size) const {
+    if (nullptr == pMapped) {
+        return;
+    }
+
+    auto range = getMappedRange(offset, size);
+
+    vkAssert(ctx.vk.vkFlushMappedMemoryRanges(ctx.device, 1, &range));
+}
+
+void host_import::invalidate(VkDeviceSize offset, VkDeviceSize size) const {
+    if (nullptr == pMapped) {
+        return;
+    }
+
+    auto range = getMappedRange(offset, size);
+
+    vkAssert(ctx.vk.vkInvalidateMappedMemoryRanges(ctx.device, 1, &range));
+}
+
+VkMappedMemoryRange host_import::getMappedRange(VkDeviceSize offset, VkDeviceSize size) const {
+    auto atomSize = std::max<VkDeviceSize> (1, ctx.physicalDeviceProperties.limits.nonCoherentAtomSize);
+    auto begin = offset / atomSize * atomSize;
+    auto end = std::min(this->size, (offset + size + atomSize - 1) / atomSize * atomSize);
+
+    VkMappedMemoryRange range {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = memory;
+    range.offset = begin;
+    // the import's size is a multiple of the host pointer alignment, not necessarily of the atom
+    range.size = end == this->size ? VK_WHOLE_SIZE : end - begin;
+
+    return range;
+}
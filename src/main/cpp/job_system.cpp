@@ -0,0 +1,326 @@
+#include "job_system.hpp"
+
+#include "util.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+    // ids are never reused, so per-thread entries of a destroyed job system can go stale but never collide
+    std::atomic<std::uint64_t> nextJobSystemId(1);
+
+    // how long the submit thread blocks on a fence before checking for new jobs again
+    const std::uint64_t FENCE_POLL_NS = 100 * 1000;
+}
+
+job_handle::job_handle() : system(nullptr) {}
+
+bool job_handle::isReady() const {
+    return nullptr == pState || pState->done.load(std::memory_order_acquire);
+}
+
+void job_handle::wait() const {
+    if (nullptr != pState) {
+        system->wait(*pState);
+    }
+}
+
+VkDescriptorSet job_recorder::allocateDescriptorSet(VkDescriptorSetLayout layout) {
+    VkDescriptorSetAllocateInfo descriptorSetAI {};
+    descriptorSetAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAI.descriptorPool = descriptorPool;
+    descriptorSetAI.descriptorSetCount = 1;
+    descriptorSetAI.pSetLayouts = &layout;
+
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    vkAssert(ctx->vk.vkAllocateDescriptorSets(ctx->device, &descriptorSetAI, &descriptorSet));
+
+    return descriptorSet;
+}
+
+job_system::job_system(context& ctx, std::uint32_t queueFamilyIndex, std::uint32_t queueIndex) : ctx(ctx), queueFamilyIndex(queueFamilyIndex) {
+    id = nextJobSystemId++;
+    pendingHead = nullptr;
+    stopping = false;
+
+    ctx.vk.vkGetDeviceQueue(ctx.device, queueFamilyIndex, queueIndex, &queue);
+
+    submitThread = std::thread(&job_system::run, this);
+}
+
+job_system::~job_system() {
+    stopping = true;
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+
+    wakeCondition.notify_one();
+
+    // run() only returns once every pushed job has been submitted and retired
+    submitThread.join();
+
+    for (auto fence : freeFences) {
+        ctx.vk.vkDestroyFence(ctx.device, fence, nullptr);
+    }
+
+    for (const auto& pResources : threads) {
+        for (const auto& slot : pResources->slots) {
+            ctx.vk.vkDestroyDescriptorPool(ctx.device, slot.descriptorPool, nullptr);
+        }
+
+        ctx.vk.vkDestroyCommandPool(ctx.device, pResources->commandPool, nullptr);
+    }
+}
+
+job_handle job_system::submit(const std::function<void(job_recorder&)>& recorder) {
+    auto& slot = acquireSlot(getThreadResources());
+
+    VkCommandBufferBeginInfo commandBufferBI {};
+    commandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    try {
+        vkAssert(ctx.vk.vkBeginCommandBuffer(slot.commandBuffer, &commandBufferBI));
+
+        auto jobRecorder = job_recorder();
+        jobRecorder.commandBuffer = slot.commandBuffer;
+        jobRecorder.ctx = &ctx;
+        jobRecorder.descriptorPool = slot.descriptorPool;
+
+        recorder(jobRecorder);
+
+        vkAssert(ctx.vk.vkEndCommandBuffer(slot.commandBuffer));
+    } catch (...) {
+        // nothing was queued; completing the state hands the slot back for reuse
+        slot.pState->done = true;
+        throw;
+    }
+
+    auto pJob = new pending_job {slot.commandBuffer, slot.pState, nullptr};
+    auto head = pendingHead.load(std::memory_order_relaxed);
+
+    do {
+        pJob->next = head;
+    } while (!pendingHead.compare_exchange_weak(head, pJob, std::memory_order_release, std::memory_order_relaxed));
+
+    // the empty critical section orders the push before the submit thread's predicate check
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+
+    wakeCondition.notify_one();
+
+    auto handle = job_handle();
+    handle.system = this;
+    handle.pState = slot.pState;
+
+    return handle;
+}
+
+job_handle job_system::submit(const compute_kernel& kernel, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) {
+    return submit([&](job_recorder& recorder) {
+        auto descriptorSet = kernel.needsDescriptorSet() ? recorder.allocateDescriptorSet(kernel.descriptorSetLayout) : VK_NULL_HANDLE;
+
+        kernel.record(recorder.commandBuffer, descriptorSet, buffers, groupCount, pushConstants);
+    });
+}
+
+job_system::thread_resources& job_system::getThreadResources() {
+    thread_local std::unordered_map<std::uint64_t, thread_resources *> local;
+
+    auto it = local.find(id);
+
+    if (it != local.end()) {
+        return *it->second;
+    }
+
+    auto resources = std::make_unique<thread_resources> ();
+
+    VkCommandPoolCreateInfo commandPoolCI {};
+    commandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCI.queueFamilyIndex = queueFamilyIndex;
+    commandPoolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    vkAssert(ctx.vk.vkCreateCommandPool(ctx.device, &commandPoolCI, nullptr, &resources->commandPool));
+
+    auto pResources = resources.get();
+
+    // the only shared lock, taken once per thread
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        threads.push_back(std::move(resources));
+    }
+
+    local[id] = pResources;
+
+    return *pResources;
+}
+
+job_system::job_slot& job_system::acquireSlot(thread_resources& resources) {
+    for (auto& slot : resources.slots) {
+        if (slot.pState->done.load(std::memory_order_acquire)) {
+            vkAssert(ctx.vk.vkResetCommandBuffer(slot.commandBuffer, 0));
+            vkAssert(ctx.vk.vkResetDescriptorPool(ctx.device, slot.descriptorPool, 0));
+
+            // handles to the previous job keep its own state
+            slot.pState = std::make_shared<job_handle::state> ();
+            slot.pState->done = false;
+
+            return slot;
+        }
+    }
+
+    auto slot = job_slot();
+
+    VkCommandBufferAllocateInfo commandBufferAI {};
+    commandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAI.commandPool = resources.commandPool;
+    commandBufferAI.commandBufferCount = 1;
+
+    vkAssert(ctx.vk.vkAllocateCommandBuffers(ctx.device, &commandBufferAI, &slot.commandBuffer));
+
+    VkDescriptorPoolSize poolSize {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = STORAGE_BUFFERS_PER_JOB;
+
+    VkDescriptorPoolCreateInfo descriptorPoolCI {};
+    descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCI.maxSets = DESCRIPTOR_SETS_PER_JOB;
+    descriptorPoolCI.poolSizeCount = 1;
+    descriptorPoolCI.pPoolSizes = &poolSize;
+
+    vkAssert(ctx.vk.vkCreateDescriptorPool(ctx.device, &descriptorPoolCI, nullptr, &slot.descriptorPool));
+
+    slot.pState = std::make_shared<job_handle::state> ();
+    slot.pState->done = false;
+
+    resources.slots.push_back(slot);
+
+    return resources.slots.back();
+}
+
+void job_system::run() {
+    while (true) {
+        submitPending();
+        retire();
+
+        if (nullptr != pendingHead.load(std::memory_order_acquire)) {
+            continue;
+        }
+
+        if (!inFlight.empty()) {
+            auto result = ctx.vk.vkWaitForFences(ctx.device, 1, &inFlight.front().fence, VK_TRUE, FENCE_POLL_NS);
+
+            if (VK_TIMEOUT != result) {
+                vkAssert(result);
+            }
+
+            continue;
+        }
+
+        if (stopping) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+
+        wakeCondition.wait(lock, [this]() {
+            return nullptr != pendingHead.load(std::memory_order_acquire) || stopping;
+        });
+    }
+}
+
+void job_system::submitPending() {
+    auto pJob = pendingHead.exchange(nullptr, std::memory_order_acquire);
+
+    if (nullptr == pJob) {
+        return;
+    }
+
+    auto jobs = std::vector<pending_job *> ();
+
+    for (; nullptr != pJob; pJob = pJob->next) {
+        jobs.push_back(pJob);
+    }
+
+    // the stack hands back the newest job first
+    std::reverse(jobs.begin(), jobs.end());
+
+    auto b = batch();
+    auto commandBuffers = std::vector<VkCommandBuffer> ();
+
+    for (auto p : jobs) {
+        commandBuffers.push_back(p->commandBuffer);
+        b.jobs.push_back(p->pState);
+        delete p;
+    }
+
+    if (freeFences.empty()) {
+        VkFenceCreateInfo fenceCI {};
+        fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        VkFence fence = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateFence(ctx.device, &fenceCI, nullptr, &fence));
+
+        freeFences.push_back(fence);
+    }
+
+    b.fence = freeFences.back();
+    freeFences.pop_back();
+
+    VkSubmitInfo submitInfo {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = commandBuffers.size();
+    submitInfo.pCommandBuffers = commandBuffers.data();
+
+    vkAssert(ctx.vk.vkQueueSubmit(queue, 1, &submitInfo, b.fence));
+
+    inFlight.push_back(std::move(b));
+}
+
+void job_system::retire() {
+    auto retired = false;
+
+    while (!inFlight.empty()) {
+        auto& b = inFlight.front();
+        auto result = ctx.vk.vkGetFenceStatus(ctx.device, b.fence);
+
+        if (VK_NOT_READY == result) {
+            break;
+        }
+
+        vkAssert(result);
+        vkAssert(ctx.vk.vkResetFences(ctx.device, 1, &b.fence));
+
+        for (const auto& pState : b.jobs) {
+            pState->done.store(true, std::memory_order_release);
+        }
+
+        freeFences.push_back(b.fence);
+        inFlight.pop_front();
+        retired = true;
+    }
+
+    if (retired) {
+        // same pattern as the wake-up: waiters check their flag under this mutex
+        {
+            std::lock_guard<std::mutex> lock(completionMutex);
+        }
+
+        completionCondition.notify_all();
+    }
+}
+
+void job_system::wait(const job_handle::state& s) {
+    if (s.done.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(completionMutex);
+
+    completionCondition.wait(lock, [&s]() {
+        return s.done.load(std::memory_order_acquire);
+    });
+}
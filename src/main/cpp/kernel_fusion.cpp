@@ -0,0 +1,478 @@
+#include "kernel_fusion.hpp"
+
+#include "util.hpp"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#endif
+
+namespace {
+    const char * getGlslType(element_type type, bool vector) {
+        switch (type) {
+            case element_type::f32:
+                return vector ? "vec4" : "float";
+            case element_type::i32:
+                return vector ? "ivec4" : "int";
+            default:
+                return vector ? "uvec4" : "uint";
+        }
+    }
+
+    // the push constant word w read as a value of the type
+    std::string fromBits(element_type type, const std::string& word) {
+        switch (type) {
+            case element_type::f32:
+                return "uintBitsToFloat(" + word + ")";
+            case element_type::i32:
+                return "int(" + word + ")";
+            default:
+                return word;
+        }
+    }
+
+    // std::hash may differ between standard libraries and builds; file names must not
+    std::uint64_t hashFnv1a(const std::string& text) {
+        std::uint64_t hash = 14695981039346656037ULL;
+
+        for (auto c : text) {
+            hash ^= static_cast<unsigned char> (c);
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    // nothing a shell would expand or stop quoting at between double quotes
+    bool isShellSafe(const std::string& text) {
+        return std::all_of(text.begin(), text.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char> (c)) || ('\0' != c && std::strchr(" /\\._-+:~", c));
+        });
+    }
+
+    bool fileEquals(const std::string& fileName, const std::string& text) {
+        std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+
+        if (!file.is_open()) {
+            return false;
+        }
+
+        std::ostringstream contents;
+        contents << file.rdbuf();
+
+        return contents.str() == text;
+    }
+
+    void writeFile(const std::string& fileName, const std::string& text) {
+        std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file: " + fileName);
+        }
+
+        file.write(text.data(), text.size());
+
+        if (!file) {
+            throw std::runtime_error("Unable to write file: " + fileName);
+        }
+    }
+}
+
+elementwise_expression::elementwise_expression(std::shared_ptr<const node> root) : root(std::move(root)) {
+}
+
+elementwise_expression elementwise_expression::input(std::uint32_t index, element_type type) {
+    return elementwise_expression(std::make_shared<const node> (node {nullptr, type, index, {}, {}}));
+}
+
+elementwise_expression elementwise_expression::apply(const std::string& opName, const std::vector<elementwise_expression>& operands, const std::vector<std::uint32_t>& parameters) const {
+    const auto& op = elementwise_library::getOp(opName);
+    auto type = getType();
+
+    if (operands.size() + 1 != op.inputCount || parameters.size() != op.parameterCount) {
+        throw std::runtime_error("Element-wise operation " + opName + " got the wrong number of inputs or parameters!");
+    }
+
+    if (std::find(op.types.begin(), op.types.end(), type) == op.types.end()) {
+        throw std::runtime_error("Element-wise operation " + opName + " is not defined for " + elementwise_library::getTypeName(type) + "!");
+    }
+
+    auto operandNodes = std::vector<std::shared_ptr<const node>> {root};
+
+    for (const auto& operand : operands) {
+        if (operand.getType() != type) {
+            throw std::runtime_error("Operands of element-wise operation " + opName + " differ in type!");
+        }
+
+        operandNodes.push_back(operand.root);
+    }
+
+    return elementwise_expression(std::make_shared<const node> (node {&op, elementwise_library::getOutputType(op, type), 0, operandNodes, parameters}));
+}
+
+element_type elementwise_expression::getType() const {
+    return root->type;
+}
+
+elementwise_fuser::elementwise_fuser(context& ctx, const std::string& cacheDirectory, VkPipelineCache pipelineCache, compile_function compile)
+        : ctx(ctx), cacheDirectory(cacheDirectory), pipelineCache(pipelineCache), compile(std::move(compile)), workgroupSize(ctx.getPreferredWorkgroupSize()), compileCount(0), prunedLayoutCount(0) {
+}
+
+void elementwise_fuser::compileWithGlslc(const std::string& sourceFileName, const std::string& spvFileName) {
+    if (!isShellSafe(sourceFileName) || !isShellSafe(spvFileName)) {
+        throw std::runtime_error("Refusing to pass " + sourceFileName + " or " + spvFileName + " to a shell!");
+    }
+
+    auto command = "glslc -c \"" + sourceFileName + "\" -o \"" + spvFileName + "\"";
+    auto status = std::system(command.c_str());
+
+    if (-1 == status) {
+        throw std::runtime_error("Unable to run glslc for " + sourceFileName + "!");
+    }
+
+#if !defined(_WIN32)
+    // std::system returns a wait status here, not the exit code
+    if (!WIFEXITED(status)) {
+        throw std::runtime_error("glslc was stopped by a signal compiling " + sourceFileName + "!");
+    }
+
+    status = WEXITSTATUS(status);
+#endif
+
+    if (0 != status) {
+        throw std::runtime_error("glslc exited with status " + std::to_string(status) + " compiling " + sourceFileName + "!");
+    }
+}
+
+std::vector<const elementwise_fuser::node *> elementwise_fuser::sortNodes(const elementwise_expression& expression) {
+    auto sorted = std::vector<const node *> ();
+    auto visited = std::set<const node *> ();
+
+    std::function<void(const node *)> visit = [&](const node * pNode) {
+        if (nullptr == pNode->op || !visited.insert(pNode).second) {
+            return;
+        }
+
+        for (const auto& operand : pNode->operands) {
+            visit(operand.get());
+        }
+
+        sorted.push_back(pNode);
+    };
+
+    visit(expression.root.get());
+
+    return sorted;
+}
+
+std::vector<element_type> elementwise_fuser::getInputTypes(const elementwise_expression& expression) {
+    auto types = std::map<std::uint32_t, element_type> ();
+
+    std::function<void(const node *)> visit = [&](const node * pNode) {
+        if (nullptr != pNode->op) {
+            for (const auto& operand : pNode->operands) {
+                visit(operand.get());
+            }
+
+            return;
+        }
+
+        auto it = types.find(pNode->inputIndex);
+
+        if (it != types.end() && it->second != pNode->type) {
+            throw std::runtime_error("Expression reads input " + std::to_string(pNode->inputIndex) + " as two types!");
+        }
+
+        types[pNode->inputIndex] = pNode->type;
+    };
+
+    visit(expression.root.get());
+
+    auto inputTypes = std::vector<element_type> ();
+
+    for (const auto& entry : types) {
+        if (entry.first != inputTypes.size()) {
+            throw std::runtime_error("Expression does not use input " + std::to_string(inputTypes.size()) + "!");
+        }
+
+        inputTypes.push_back(entry.second);
+    }
+
+    return inputTypes;
+}
+
+std::string elementwise_fuser::generateSource(const elementwise_expression& expression) {
+    auto nodes = sortNodes(expression);
+    auto inputTypes = getInputTypes(expression);
+    auto inputCount = static_cast<std::uint32_t> (inputTypes.size());
+    auto outputType = expression.getType();
+
+    auto parameterCount = std::uint32_t(0);
+
+    for (auto pNode : nodes) {
+        parameterCount += pNode->parameters.size();
+    }
+
+    std::ostringstream source;
+
+    source << "#version 450 core\n\n";
+    source << "// generated by elementwise_fuser\n\n";
+
+    // MAD as in elementwise.comp, as overloads so operations of different types can share a shader
+    for (auto type : {element_type::f32, element_type::i32, element_type::u32}) {
+        for (auto vector : {true, false}) {
+            auto glslType = getGlslType(type, vector);
+            auto body = element_type::f32 == type ? "fma(x, y, z)" : "x * y + z";
+
+            source << glslType << " MAD(" << glslType << " x, " << glslType << " y, " << glslType << " z) {\n";
+            source << "    return " << body << ";\n";
+            source << "}\n\n";
+        }
+    }
+
+    // the inputs and then the output as 4-vectors, then the same buffers again as scalars
+    for (std::uint32_t i = 0; i <= inputCount; i++) {
+        for (auto vector : {true, false}) {
+            auto isOutput = i == inputCount;
+            auto type = isOutput ? outputType : inputTypes[i];
+            auto binding = vector ? i : inputCount + 1 + i;
+            auto name = (vector ? std::string("u") : std::string("uScalar")) + (isOutput ? std::string("Outputs") : "Inputs" + std::to_string(i));
+
+            source << "layout (binding = " << binding << ", std430) " << (isOutput ? "writeonly" : "readonly") << " buffer Binding" << binding << " {\n";
+            source << "    " << getGlslType(type, vector) << " " << name << "[];\n";
+            source << "};\n\n";
+        }
+    }
+
+    source << "layout (push_constant) uniform Parameters {\n";
+    source << "    uint uCount;\n";
+
+    if (0 != parameterCount) {
+        source << "    uint uParameters[" << parameterCount << "];\n";
+    }
+
+    source << "};\n\n";
+
+    // one overload for vectors and one for the tail; every node is a scope of its own, so the
+    // operation's expression sees its operands as a, b and c and its parameters as p0 and p1
+    for (auto vector : {true, false}) {
+        source << getGlslType(outputType, vector) << " evaluate(";
+
+        for (std::uint32_t i = 0; i < inputCount; i++) {
+            source << (0 == i ? "" : ", ") << getGlslType(inputTypes[i], vector) << " in" << i;
+        }
+
+        source << ") {\n";
+
+        auto names = std::map<const node *, std::string> ();
+        auto parameterIndex = std::uint32_t(0);
+
+        auto getName = [&names](const node * pNode) {
+            return nullptr == pNode->op ? "in" + std::to_string(pNode->inputIndex) : names.at(pNode);
+        };
+
+        for (auto pNode : nodes) {
+            auto name = "t" + std::to_string(names.size());
+            auto inputType = pNode->operands[0]->type;
+            auto inputGlslType = getGlslType(inputType, vector);
+            auto outputGlslType = getGlslType(pNode->type, vector);
+
+            source << "    " << outputGlslType << " " << name << ";\n";
+            source << "    {\n";
+
+            for (std::size_t i = 0; i < pNode->operands.size(); i++) {
+                source << "        " << inputGlslType << " " << static_cast<char> ('a' + i) << " = " << getName(pNode->operands[i].get()) << ";\n";
+            }
+
+            for (std::size_t i = 0; i < pNode->parameters.size(); i++) {
+                source << "        " << inputGlslType << " p" << i << " = " << inputGlslType << "(" << fromBits(inputType, "uParameters[" + std::to_string(parameterIndex++) + "]") << ");\n";
+            }
+
+            source << "        " << name << " = " << outputGlslType << "(" << pNode->op->expression << ");\n";
+            source << "    }\n";
+
+            names[pNode] = name;
+        }
+
+        source << "    return " << getName(expression.root.get()) << ";\n";
+        source << "}\n\n";
+    }
+
+    source << "// workgroup size is specialization constant 0; the host always supplies it\n";
+    source << "layout (local_size_x_id = 0) in;\n";
+    source << "void main() {\n";
+    source << "    uint stride = gl_NumWorkGroups.x * gl_WorkGroupSize.x;\n";
+    source << "    uint vectorCount = uCount / 4;\n\n";
+    source << "    for (uint id = gl_GlobalInvocationID.x; id < vectorCount; id += stride) {\n";
+    source << "        uOutputs[id] = evaluate(";
+
+    for (std::uint32_t i = 0; i < inputCount; i++) {
+        source << (0 == i ? "" : ", ") << "uInputs" << i << "[id]";
+    }
+
+    source << ");\n";
+    source << "    }\n\n";
+    source << "    uint tail = vectorCount * 4 + gl_GlobalInvocationID.x;\n\n";
+    source << "    if (tail < uCount) {\n";
+    source << "        uScalarOutputs[tail] = evaluate(";
+
+    for (std::uint32_t i = 0; i < inputCount; i++) {
+        source << (0 == i ? "" : ", ") << "uScalarInputs" << i << "[tail]";
+    }
+
+    source << ");\n";
+    source << "    }\n";
+    source << "}\n";
+
+    return source.str();
+}
+
+compute_kernel& elementwise_fuser::get(const elementwise_expression& expression) {
+    return *getLayout(expression).pKernel;
+}
+
+void elementwise_fuser::dispatch(const elementwise_expression& expression, const std::vector<VkBuffer>& inputs, VkBuffer output, std::uint32_t count) {
+    const auto& l = getLayout(expression);
+
+    if (inputs.size() != l.inputCount) {
+        throw std::runtime_error("Fused expression got the wrong number of inputs!");
+    }
+
+    auto operands = inputs;
+    operands.push_back(output);
+
+    auto buffers = operands;
+    buffers.insert(buffers.end(), operands.begin(), operands.end());
+
+    // in the order generateSource() numbered them
+    auto pushConstants = std::vector<std::uint32_t> {count};
+
+    for (auto pNode : l.nodes) {
+        pushConstants.insert(pushConstants.end(), pNode->parameters.begin(), pNode->parameters.end());
+    }
+
+    // one vec4 per invocation, and the first invocations also take one element of the tail each
+    auto invocationCount = std::max(count / 4, count % 4);
+
+    l.pKernel->dispatch(buffers, ctx.getGroupCount(invocationCount, workgroupSize), pushConstants);
+}
+
+void elementwise_fuser::forget(VkBuffer buffer) {
+    for (auto& entry : kernels) {
+        entry.second->forget(buffer);
+    }
+}
+
+std::uint32_t elementwise_fuser::getCompileCount() const {
+    return compileCount;
+}
+
+const elementwise_fuser::layout& elementwise_fuser::getLayout(const elementwise_expression& expression) {
+    auto pRoot = expression.root.get();
+    auto it = layouts.find(pRoot);
+
+    // a live root at the same address is the same immutable node
+    if (it != layouts.end() && !it->second.first.expired()) {
+        return it->second.second;
+    }
+
+    auto l = layout();
+    l.nodes = sortNodes(expression);
+    l.inputCount = static_cast<std::uint32_t> (getInputTypes(expression).size());
+
+    auto parameterCount = std::uint32_t(0);
+
+    for (auto pNode : l.nodes) {
+        parameterCount += pNode->parameters.size();
+    }
+
+    auto source = generateSource(expression);
+    auto kernelIt = kernels.find(source);
+
+    if (kernelIt != kernels.end()) {
+        l.pKernel = kernelIt->second.get();
+    } else {
+        const auto& limits = ctx.physicalDeviceProperties.limits;
+        auto bindingCount = 2 * (l.inputCount + 1);
+        auto pushConstantBytes = sizeof(std::uint32_t) * (1 + parameterCount);
+
+        // checked here, since pipeline creation would only report a bare VkResult
+        if (bindingCount > limits.maxPerStageDescriptorStorageBuffers) {
+            throw std::runtime_error("Fused expression with " + std::to_string(l.inputCount) + " inputs needs " + std::to_string(bindingCount)
+                    + " storage buffers, but the device allows " + std::to_string(limits.maxPerStageDescriptorStorageBuffers) + " per stage!");
+        }
+
+        if (pushConstantBytes > limits.maxPushConstantsSize) {
+            throw std::runtime_error("Fused expression with " + std::to_string(parameterCount) + " parameters needs " + std::to_string(pushConstantBytes)
+                    + " bytes of push constants, but the device allows " + std::to_string(limits.maxPushConstantsSize) + "!");
+        }
+
+        auto pKernel = std::make_unique<compute_kernel> (ctx, "fused", loadOrCompile(source), bindingCount, pipelineCache, std::vector<std::uint32_t> {workgroupSize}, 1 + parameterCount);
+
+        l.pKernel = pKernel.get();
+        kernels[source] = std::move(pKernel);
+    }
+
+    // drops the layouts of expressions that are gone whenever the map has doubled since the last time
+    if (layouts.size() >= 2 * prunedLayoutCount + 16) {
+        for (auto entry = layouts.begin(); entry != layouts.end();) {
+            entry = entry->second.first.expired() ? layouts.erase(entry) : std::next(entry);
+        }
+
+        prunedLayoutCount = layouts.size();
+    }
+
+    auto& entry = layouts[pRoot];
+    entry = std::make_pair(std::weak_ptr<const node> (expression.root), std::move(l));
+
+    return entry.second;
+}
+
+std::vector<char> elementwise_fuser::loadOrCompile(const std::string& source) {
+    std::ostringstream baseName;
+    baseName << cacheDirectory << "/fused_" << std::hex << std::setw(16) << std::setfill('0') << hashFnv1a(source);
+
+    auto sourceFileName = baseName.str() + ".comp";
+    auto spvFileName = baseName.str() + ".spv";
+
+    // the source is written before the SPIR-V is, so a matching source vouches for the SPIR-V next
+    // to it unless compilation failed, and then there is no SPIR-V to find
+    if (fileEquals(sourceFileName, source)) {
+        std::ifstream spvFile(spvFileName.c_str(), std::ios::in | std::ios::binary);
+
+        if (spvFile.is_open()) {
+            spvFile.close();
+
+            return readFile(spvFileName);
+        }
+    }
+
+    std::remove(spvFileName.c_str());
+    writeFile(sourceFileName, source);
+
+    auto tmpFileName = spvFileName + ".tmp";
+    compile(sourceFileName, tmpFileName);
+
+    if (0 != std::rename(tmpFileName.c_str(), spvFileName.c_str())) {
+        throw std::runtime_error("Unable to replace file: " + spvFileName);
+    }
+
+    compileCount++;
+
+    return readFile(spvFileName);
+}
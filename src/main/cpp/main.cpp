@@ -1,488 +1,947 @@
 #include "volk.h"
 
+#include "compute_kernel.hpp"
+#include "context.hpp"
+#include "elementwise_library.hpp"
+#include "gpu_profiler.hpp"
+#include "host_import.hpp"
+#include "kernel_fusion.hpp"
+#include "job_system.hpp"
+#include "mapped_file.hpp"
+#include "multi_device.hpp"
+#include "pipeline_cache.hpp"
+#include "queue_scheduler.hpp"
+#include "radix_sort.hpp"
+#include "reduction.hpp"
+#include "scan.hpp"
+#include "staging_ring.hpp"
+#include "submission_queue.hpp"
+#include "util.hpp"
+
+#include <cctype>
+#include <cerrno>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 
 #include <algorithm>
-#include <fstream>
+#include <chrono>
 #include <iostream>
-#include <limits>
 #include <memory>
 #include <stdexcept>
-#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
-struct context {
-    VkInstance instance;
-    VkPhysicalDevice physicalDevice;
-    VkDevice device;
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-    std::vector<std::uint32_t> computeQueueFamilyIds;
+namespace {
+    std::vector<float> makeInputs() {
+        auto inputData = std::vector<float>();
+        std::cout << "Compute Shader Squaring\n";
+        std::cout << "Inputs: [";
 
-    context();
+        for (int i = 0; i < 32; i++) {
+            inputData.push_back(static_cast<float> (i));
+            std::cout << inputData[i];
 
-    ~context();
+            if (i != 31) {
+                std::cout << ", ";
+            }
+        }
 
-    std::uint32_t getMemoryTypeIndex(std::uint32_t typeBits, unsigned int requirementsMask);
+        std::cout << "]" << std::endl;
 
-    VkDeviceMemory bindMemory(VkBuffer buffer);
-};
+        return inputData;
+    }
 
-std::string translateVulkanResult(VkResult result);
+    void printOutputs(const float * pResults, std::size_t count) {
+        std::cout << "Output: [";
 
-void vkAssert(VkResult result);
+        for (std::size_t i = 0; i < count; i++) {
+            std::cout << pResults[i];
 
-void bindMemory(context& ctx, VkBuffer buffer);
+            if (i != count - 1) {
+                std::cout << ", ";
+            }
+        }
 
-std::vector<char> readFile(const std::string& fileName);
+        std::cout << "]" << std::endl;
+    }
 
-int main(int argc, char** argv) {
-    context ctx;
+    // a device address as the two push constant words a GLSL buffer reference is read from
+    void pushAddress(std::vector<std::uint32_t>& words, std::uint64_t address) {
+        words.push_back(static_cast<std::uint32_t> (address));
+        words.push_back(static_cast<std::uint32_t> (address >> 32));
+    }
+
+    // squares one share of the input per device, all devices at once, and returns how long each took
+    std::vector<double> squareOnDevices(multi_device& devices, std::vector<std::unique_ptr<compute_kernel>>& kernels, std::vector<std::unique_ptr<submission_queue>>& queues,
+            const std::vector<multi_device::range>& ranges, const std::vector<float>& inputData, std::vector<float>& outputData) {
+        struct share {
+            VkBuffer inputBuffer;
+            VkBuffer outputBuffer;
+            memory_allocation inputMemory;
+            memory_allocation outputMemory;
+            job_future job;
+            std::chrono::steady_clock::time_point start;
+            double milliseconds;
+        };
+
+        auto shares = std::vector<share> (ranges.size());
+
+        for (std::size_t i = 0; i < ranges.size(); i++) {
+            auto& ctx = *devices.contexts[i];
+            auto& s = shares[i];
+
+            s.milliseconds = 0.0;
+
+            if (0 == ranges[i].count) {
+                continue;
+            }
+
+            // host-visible buffers keep the gather simple; every device has such a memory type
+            VkBufferCreateInfo bufferCI {};
+            bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+            bufferCI.size = ranges[i].count * sizeof(float);
+
+            vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &s.inputBuffer));
+            s.inputMemory = ctx.bindMemory(s.inputBuffer, memory_policy::upload());
+            vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &s.outputBuffer));
+            s.outputMemory = ctx.bindMemory(s.outputBuffer, memory_policy::readbackCached());
 
-    auto inputData = std::vector<float>();
-    std::cout << "Compute Shader Squaring\n";
-    std::cout << "Inputs: [";
+            std::copy(inputData.begin() + ranges[i].offset, inputData.begin() + ranges[i].offset + ranges[i].count, static_cast<float *> (s.inputMemory.pMapped));
+            ctx.flushMemory(s.inputMemory);
 
-    for (int i = 0; i < 32; i++) {
-        inputData.push_back(static_cast<float> (i));
-        std::cout << inputData[i];
+            auto workgroupSize = ctx.getPreferredWorkgroupSize();
+            auto invocationCount = std::max(ranges[i].count / 4, ranges[i].count % 4);
+            auto buffers = std::vector<VkBuffer> {s.inputBuffer, s.outputBuffer, s.inputBuffer, s.outputBuffer};
 
-        if (i != 31) {
-            std::cout << ", ";
+            auto parameters = std::vector<std::uint32_t> {static_cast<std::uint32_t> (ranges[i].count)};
+
+            s.job = kernels[i]->submit(*queues[i], buffers, ctx.getGroupCount(invocationCount, workgroupSize), parameters);
+
+            // each device's clock starts at its own submit, so the setup of the devices before it does not count
+            s.start = std::chrono::steady_clock::now();
         }
-    }
 
-    std::cout << "]" << std::endl;
+        // poll rather than wait in order, so a fast device is not timed by a slow one ahead of it. The
+        // fences belong to different VkDevices, so one vkWaitForFences cannot cover them all.
+        auto pending = std::count_if(ranges.begin(), ranges.end(), [](const multi_device::range& r) {
+            return 0 != r.count;
+        });
 
-    VkBufferCreateInfo bufferCI {};
-    bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-    bufferCI.size = inputData.size() * sizeof(float);
+        auto done = std::vector<bool> (ranges.size(), false);
 
-    VkBuffer inputBuffer = VK_NULL_HANDLE;
-    vkAssert(vkCreateBuffer(ctx.device, &bufferCI, nullptr, &inputBuffer));
-    auto inputMemory = ctx.bindMemory(inputBuffer);
+        while (pending > 0) {
+            for (std::size_t i = 0; i < ranges.size(); i++) {
+                if (0 == ranges[i].count || done[i] || !shares[i].job.isReady()) {
+                    continue;
+                }
 
-    float *pData = nullptr;
-    vkAssert(vkMapMemory(ctx.device, inputMemory, 0, inputData.size() * sizeof(float), 0, reinterpret_cast<void **> (&pData)));
+                shares[i].milliseconds = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - shares[i].start).count();
+                done[i] = true;
+                pending--;
+            }
 
-    std::copy(inputData.begin(), inputData.end(), pData);
+            if (pending > 0) {
+                std::this_thread::yield();
+            }
+        }
 
-    vkUnmapMemory(ctx.device, inputMemory);
+        auto milliseconds = std::vector<double> ();
 
-    VkBuffer outputBuffer = VK_NULL_HANDLE;
-    vkAssert(vkCreateBuffer(ctx.device, &bufferCI, nullptr, &outputBuffer));
-    auto outputMemory = ctx.bindMemory(outputBuffer);
+        for (std::size_t i = 0; i < ranges.size(); i++) {
+            auto& ctx = *devices.contexts[i];
+            auto& s = shares[i];
 
-    auto descriptorSetLayoutBindings = std::vector<VkDescriptorSetLayoutBinding>();
-    {
-        VkDescriptorSetLayoutBinding binding {};
-        binding.binding = 0;
-        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        binding.descriptorCount = 1;
-        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-        
-        descriptorSetLayoutBindings.push_back(binding);
+            milliseconds.push_back(s.milliseconds);
 
-        binding.binding = 1;
-        descriptorSetLayoutBindings.push_back(binding);
+            if (0 == ranges[i].count) {
+                continue;
+            }
+
+            auto pResults = static_cast<const float *> (s.outputMemory.pMapped);
+
+            ctx.invalidateMemory(s.outputMemory);
+            std::copy(pResults, pResults + ranges[i].count, outputData.begin() + ranges[i].offset);
+
+            // the weighted pass creates new buffers that may reuse these handles
+            kernels[i]->forget(s.outputBuffer);
+            kernels[i]->forget(s.inputBuffer);
+
+            ctx.vk.vkDestroyBuffer(ctx.device, s.outputBuffer, nullptr);
+            ctx.freeMemory(s.outputMemory);
+            ctx.vk.vkDestroyBuffer(ctx.device, s.inputBuffer, nullptr);
+            ctx.freeMemory(s.inputMemory);
+        }
+
+        return milliseconds;
     }
 
-    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI {};
-    descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    descriptorSetLayoutCI.bindingCount = descriptorSetLayoutBindings.size();
-    descriptorSetLayoutCI.pBindings = descriptorSetLayoutBindings.data();
+    // splits the input over every GPU by the throughput each one showed on a calibration input large
+    // enough to be bandwidth-bound
+    int squareOnAllDevices() {
+        multi_device devices;
 
-    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
-    vkAssert(vkCreateDescriptorSetLayout(ctx.device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+        auto inputData = makeInputs();
+        auto outputData = std::vector<float> (inputData.size());
+        auto spvCode = readFile("square.comp.spv");
+        auto queues = std::vector<std::unique_ptr<submission_queue>> ();
+        auto kernels = std::vector<std::unique_ptr<compute_kernel>> ();
 
-    VkPipelineLayoutCreateInfo pipelineLayoutCI {};
-    pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutCI.setLayoutCount = 1;
-    pipelineLayoutCI.pSetLayouts = &descriptorSetLayout;
+        for (auto& ctx : devices.contexts) {
+            queues.push_back(std::make_unique<submission_queue> (*ctx, ctx->computeQueueFamilyIds[0]));
+            kernels.push_back(std::make_unique<compute_kernel> (*ctx, "square", spvCode, 4, VK_NULL_HANDLE, std::vector<std::uint32_t> {ctx->getPreferredWorkgroupSize()}, 1));
+        }
+
+        // every device squares the whole calibration input, once to warm up and once to be timed
+        auto calibrationData = std::vector<float> (multi_device::CALIBRATION_ELEMENTS, 1.0f);
+        auto calibrationOutput = std::vector<float> (calibrationData.size());
+        auto calibrationRanges = std::vector<multi_device::range> (devices.contexts.size(), multi_device::range {0, calibrationData.size()});
+
+        squareOnDevices(devices, kernels, queues, calibrationRanges, calibrationData, calibrationOutput);
+
+        auto milliseconds = squareOnDevices(devices, kernels, queues, calibrationRanges, calibrationData, calibrationOutput);
+
+        for (std::size_t i = 0; i < calibrationRanges.size(); i++) {
+            devices.recordThroughput(i, calibrationRanges[i].count, milliseconds[i]);
+        }
 
-    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
-    vkAssert(vkCreatePipelineLayout(ctx.device, &pipelineLayoutCI, nullptr, &pipelineLayout));
+        // ranges stay multiples of a vec4 so only the last device handles a scalar tail
+        auto ranges = devices.partition(inputData.size(), 4);
 
-    auto descriptorSetPoolSizes = std::vector<VkDescriptorPoolSize>();
-    {
-        VkDescriptorPoolSize poolSize {};
-        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        poolSize.descriptorCount = 2;
+        squareOnDevices(devices, kernels, queues, ranges, inputData, outputData);
 
-        descriptorSetPoolSizes.push_back(poolSize);
+        for (std::size_t i = 0; i < ranges.size(); i++) {
+            std::cout << devices.contexts[i]->physicalDeviceProperties.deviceName << ": " << ranges[i].count << " elements\n";
+        }
+
+        printOutputs(outputData.data(), outputData.size());
+
+        return 0;
     }
 
-    VkDescriptorPoolCreateInfo descriptorPoolCI {};
-    descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descriptorPoolCI.maxSets = 2;
-    descriptorPoolCI.poolSizeCount = descriptorSetPoolSizes.size();
-    descriptorPoolCI.pPoolSizes = descriptorSetPoolSizes.data();
+    // every thread squares its own slice through the shared job system, with no locking of its own
+    int squareOnThreads(std::uint32_t threadCount) {
+        context ctx;
 
-    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
-    vkAssert(vkCreateDescriptorPool(ctx.device, &descriptorPoolCI, nullptr, &descriptorPool));
+        auto inputData = makeInputs();
+        auto outputData = std::vector<float> (inputData.size());
+        auto workgroupSize = ctx.getPreferredWorkgroupSize();
 
-    VkDescriptorSetAllocateInfo descriptorSetAI {};
-    descriptorSetAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    descriptorSetAI.descriptorPool = descriptorPool;
-    descriptorSetAI.descriptorSetCount = 1;
-    descriptorSetAI.pSetLayouts = &descriptorSetLayout;
+        compute_kernel squareKernel(ctx, "square", readFile("square.comp.spv"), 4, VK_NULL_HANDLE, {workgroupSize}, 1);
+        job_system jobs(ctx, ctx.computeQueueFamilyIds[0]);
 
-    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-    vkAssert(vkAllocateDescriptorSets(ctx.device, &descriptorSetAI, &descriptorSet));
+        auto threads = std::vector<std::thread> ();
+        auto sliceSize = (inputData.size() + threadCount - 1) / threadCount;
 
-    auto descriptorBufferInfos = std::vector<VkDescriptorBufferInfo> (); 
-    {
-        VkDescriptorBufferInfo bufferInfo {};
-        bufferInfo.buffer = inputBuffer;
-        bufferInfo.offset = 0;
-        bufferInfo.range = VK_WHOLE_SIZE;
+        for (std::uint32_t t = 0; t < threadCount; t++) {
+            auto begin = std::min(inputData.size(), t * sliceSize);
+            auto count = std::min(inputData.size() - begin, sliceSize);
 
-        descriptorBufferInfos.push_back(bufferInfo);
+            if (0 == count) {
+                break;
+            }
 
-        bufferInfo.buffer = outputBuffer;
-        descriptorBufferInfos.push_back(bufferInfo);
-    }
+            threads.emplace_back([&, begin, count]() {
+                VkBufferCreateInfo bufferCI {};
+                bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+                bufferCI.size = count * sizeof(float);
+
+                VkBuffer inputBuffer = VK_NULL_HANDLE;
+                vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &inputBuffer));
+                auto inputMemory = ctx.bindMemory(inputBuffer, memory_policy::upload());
 
-    auto descriptorSetWrites = std::vector<VkWriteDescriptorSet> ();
-    {
+                VkBuffer outputBuffer = VK_NULL_HANDLE;
+                vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &outputBuffer));
+                auto outputMemory = ctx.bindMemory(outputBuffer, memory_policy::readbackCached());
 
-        VkWriteDescriptorSet write {};
-        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write.descriptorCount = 1;
-        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        write.pBufferInfo = descriptorBufferInfos.data();
-        write.dstBinding = 0;
-        write.dstSet = descriptorSet;
+                // slices may share an arena block, but its mapping is persistent, so no thread maps or locks anything
+                std::copy(inputData.begin() + begin, inputData.begin() + begin + count, static_cast<float *> (inputMemory.pMapped));
+                ctx.flushMemory(inputMemory);
 
-        descriptorSetWrites.push_back(write);
+                auto invocationCount = std::max(count / 4, count % 4);
+                auto buffers = std::vector<VkBuffer> {inputBuffer, outputBuffer, inputBuffer, outputBuffer};
+                auto parameters = std::vector<std::uint32_t> {static_cast<std::uint32_t> (count)};
 
-        write.pBufferInfo += 1;
-        write.dstBinding = 1;
+                jobs.submit(squareKernel, buffers, ctx.getGroupCount(invocationCount, workgroupSize), parameters).wait();
+
+                auto pResults = static_cast<const float *> (outputMemory.pMapped);
+
+                ctx.invalidateMemory(outputMemory);
+                std::copy(pResults, pResults + count, outputData.begin() + begin);
+
+                ctx.vk.vkDestroyBuffer(ctx.device, outputBuffer, nullptr);
+                ctx.freeMemory(outputMemory);
+                ctx.vk.vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+                ctx.freeMemory(inputMemory);
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
 
-        descriptorSetWrites.push_back(write);
+        printOutputs(outputData.data(), outputData.size());
+
+        return 0;
     }
 
-    vkUpdateDescriptorSets(ctx.device, descriptorSetWrites.size(), descriptorSetWrites.data(), 0, nullptr);
+    // the largest slice of a file one dispatch works on; whole 64KB steps keep every slice's
+    // offset aligned for buffers bound into imported memory
+    const VkDeviceSize FILE_CHUNK_BYTES = 256 * 1024 * 1024;
+    const VkDeviceSize FILE_CHUNK_GRANULARITY = 64 * 1024;
 
-    auto spvCode = readFile("square.comp.spv");
+    void squareChunk(context& ctx, compute_kernel& kernel, VkBuffer inputBuffer, VkBuffer outputBuffer, VkDeviceSize count) {
+        auto buffers = std::vector<VkBuffer> {inputBuffer, outputBuffer, inputBuffer, outputBuffer};
+        auto invocationCount = std::max(count / 4, count % 4);
 
-    VkShaderModuleCreateInfo shaderModuleCI {};
-    shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shaderModuleCI.codeSize = spvCode.size();
-    shaderModuleCI.pCode = reinterpret_cast<const std::uint32_t *> (spvCode.data());
+        kernel.dispatch(buffers, ctx.getGroupCount(invocationCount, ctx.getPreferredWorkgroupSize()), {static_cast<std::uint32_t> (count)});
 
-    VkShaderModule computeShaderModule = VK_NULL_HANDLE;
-    vkAssert(vkCreateShaderModule(ctx.device, &shaderModuleCI, nullptr, &computeShaderModule));
+        // the next chunk's buffers may get the same handles
+        kernel.forget(inputBuffer);
+        kernel.forget(outputBuffer);
+    }
 
-    VkPipelineShaderStageCreateInfo computeStageCI {};
-    computeStageCI.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    computeStageCI.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-    computeStageCI.module = computeShaderModule;
-    computeStageCI.pName = "main";
+    // creates, dispatches, forgets and destroys a buffer pair many times over, as squareChunk() does,
+    // and fails if the kernel's descriptor pools grow past what MAX_CACHED_BINDINGS sets need
+    int checkForgetCycles() {
+        context ctx;
 
-    VkComputePipelineCreateInfo computePipelineCI {};
-    computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    computePipelineCI.stage = computeStageCI;
-    computePipelineCI.layout = pipelineLayout;
+        const std::uint32_t bindingCount = 4;
+        const std::uint32_t count = 32;
 
-    VkPipeline pipeline = VK_NULL_HANDLE;
-    vkAssert(vkCreateComputePipelines(ctx.device, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr, &pipeline));
+        compute_kernel squareKernel(ctx, "square", readFile("square.comp.spv"), bindingCount, VK_NULL_HANDLE, {ctx.getPreferredWorkgroupSize()}, 1);
 
-    vkDestroyShaderModule(ctx.device, computeShaderModule, nullptr);
+        VkBufferCreateInfo bufferCI {};
+        bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferCI.size = count * sizeof(float);
 
-    VkCommandPoolCreateInfo commandPoolCI {};
-    commandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    commandPoolCI.queueFamilyIndex = ctx.computeQueueFamilyIds[0];
-    commandPoolCI.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        for (std::uint32_t i = 0; i < 4 * compute_kernel::MAX_CACHED_BINDINGS; i++) {
+            VkBuffer inputBuffer = VK_NULL_HANDLE;
+            vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &inputBuffer));
+            auto inputMemory = ctx.bindMemory(inputBuffer, memory_policy::gpuOnly());
 
-    VkCommandPool commandPool = VK_NULL_HANDLE;
-    vkAssert(vkCreateCommandPool(ctx.device, &commandPoolCI, nullptr, &commandPool));
+            VkBuffer outputBuffer = VK_NULL_HANDLE;
+            vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &outputBuffer));
+            auto outputMemory = ctx.bindMemory(outputBuffer, memory_policy::gpuOnly());
 
-    VkCommandBufferAllocateInfo commandBufferAI {};
-    commandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAI.commandPool = commandPool;
-    commandBufferAI.commandBufferCount = 1;
+            squareChunk(ctx, squareKernel, inputBuffer, outputBuffer, count);
 
-    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
-    vkAssert(vkAllocateCommandBuffers(ctx.device, &commandBufferAI, &commandBuffer));
+            ctx.vk.vkDestroyBuffer(ctx.device, outputBuffer, nullptr);
+            ctx.freeMemory(outputMemory);
+            ctx.vk.vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+            ctx.freeMemory(inputMemory);
+        }
 
-    VkCommandBufferBeginInfo commandBufferBI {};
-    commandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    commandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        // a pool holds SETS_PER_POOL sets or STORAGE_BUFFERS_PER_POOL bindings, whichever runs out first
+        std::uint32_t setsPerPool = descriptor_allocator::SETS_PER_POOL;
+        setsPerPool = std::min(setsPerPool, descriptor_allocator::STORAGE_BUFFERS_PER_POOL / bindingCount);
+        auto maxPoolCount = (compute_kernel::MAX_CACHED_BINDINGS + setsPerPool - 1) / setsPerPool;
+        auto poolCount = squareKernel.getDescriptorPoolCount();
 
-    vkAssert(vkBeginCommandBuffer(commandBuffer, &commandBufferBI));
+        std::cout << "Descriptor pools after " << 4 * compute_kernel::MAX_CACHED_BINDINGS << " forget cycles: " << poolCount << " (at most " << maxPoolCount << ")" << std::endl;
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
-    // local group size is (32x1x1); this command needs the number of groups.
-    vkCmdDispatch(commandBuffer, inputData.size() / 32, 1, 1);
+        return poolCount <= maxPoolCount ? 0 : 1;
+    }
 
-    vkAssert(vkEndCommandBuffer(commandBuffer));
+    // squares a file of raw floats into another without building a std::vector. Both files are
+    // memory-mapped; where VK_EXT_external_memory_host can import the mappings the kernel works on
+    // the file pages in place, otherwise every chunk is copied once into and once out of a buffer.
+    int squareFile(const std::string& inputPath, const std::string& outputPath) {
+        context ctx;
+
+        auto input = mapped_file::openInput(inputPath);
+        auto count = input.getSize() / sizeof(float);
+        auto bytes = count * sizeof(float);
+
+        if (0 == count) {
+            throw std::runtime_error(inputPath + " holds no complete float!");
+        }
 
-    VkQueue queue = VK_NULL_HANDLE;
-    vkGetDeviceQueue(ctx.device, ctx.computeQueueFamilyIds[0], 0, &queue);
+        auto output = mapped_file::createOutput(outputPath, bytes);
+        auto chunkBytes = std::min<VkDeviceSize> (ctx.physicalDeviceProperties.limits.maxStorageBufferRange, FILE_CHUNK_BYTES) / FILE_CHUNK_GRANULARITY * FILE_CHUNK_GRANULARITY;
 
-    VkFenceCreateInfo fenceCI {};
-    fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        compute_kernel squareKernel(ctx, "square", readFile("square.comp.spv"), 4, VK_NULL_HANDLE, {ctx.getPreferredWorkgroupSize()}, 1);
 
-    VkFence taskCompleteFence = VK_NULL_HANDLE;
-    vkAssert(vkCreateFence(ctx.device, &fenceCI, nullptr, &taskCompleteFence));
+        auto pInput = static_cast<const char *> (input.getData());
+        auto pOutput = static_cast<char *> (output.getData());
 
-    VkSubmitInfo submitInfo {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    
-    vkAssert(vkQueueSubmit(queue, 1, &submitInfo, taskCompleteFence));
-    vkAssert(vkWaitForFences(ctx.device, 1, &taskCompleteFence, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+        if (host_import::isSupported(ctx, input.getData(), input.getMappedSize()) && host_import::isSupported(ctx, output.getData(), output.getMappedSize())) {
+            // drivers may still refuse file-backed pages, at import or at bind; then every chunk is copied
+            try {
+                host_import inputImport(ctx, input.getData(), input.getMappedSize());
+                host_import outputImport(ctx, output.getData(), output.getMappedSize());
 
-    vkDestroyFence(ctx.device, taskCompleteFence, nullptr);
-    
-    float * pResults = nullptr;
+                for (VkDeviceSize offset = 0; offset < bytes; offset += chunkBytes) {
+                    auto size = std::min(chunkBytes, bytes - offset);
+                    auto inputBuffer = inputImport.createBuffer(offset, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+                    VkBuffer outputBuffer = VK_NULL_HANDLE;
 
-    vkAssert(vkMapMemory(ctx.device, outputMemory, 0, inputData.size() * sizeof(float), 0, reinterpret_cast<void **> (&pResults)));
+                    try {
+                        outputBuffer = outputImport.createBuffer(offset, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+                    } catch (...) {
+                        ctx.vk.vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+                        throw;
+                    }
 
-    std::cout << "Output: [";
+                    inputImport.flush(offset, size);
+                    squareChunk(ctx, squareKernel, inputBuffer, outputBuffer, size / sizeof(float));
+                    outputImport.invalidate(offset, size);
 
-    for (int i = 0; i < inputData.size(); i++) {
-        std::cout << pResults[i];
+                    ctx.vk.vkDestroyBuffer(ctx.device, outputBuffer, nullptr);
+                    ctx.vk.vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+                }
 
-        if (i != inputData.size() - 1) {
-            std::cout << ", ";
+                std::cout << "Squared " << count << " floats in place in the imported file mappings" << std::endl;
+
+                return 0;
+            } catch (const std::runtime_error& ex) {
+                std::cerr << "Could not import the file mappings (" << ex.what() << "), copying instead" << std::endl;
+            }
         }
+
+        VkBufferCreateInfo bufferCI {};
+        bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferCI.size = std::min(chunkBytes, bytes);
+
+        VkBuffer inputBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &inputBuffer));
+        auto inputMemory = ctx.bindMemory(inputBuffer, memory_policy::upload());
+
+        VkBuffer outputBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &outputBuffer));
+        auto outputMemory = ctx.bindMemory(outputBuffer, memory_policy::readbackCached());
+
+        for (VkDeviceSize offset = 0; offset < bytes; offset += chunkBytes) {
+            auto size = std::min(chunkBytes, bytes - offset);
+
+            std::memcpy(inputMemory.pMapped, pInput + offset, size);
+            ctx.flushMemory(inputMemory, 0, size);
+
+            squareChunk(ctx, squareKernel, inputBuffer, outputBuffer, size / sizeof(float));
+
+            ctx.invalidateMemory(outputMemory, 0, size);
+            std::memcpy(pOutput + offset, outputMemory.pMapped, size);
+        }
+
+        ctx.vk.vkDestroyBuffer(ctx.device, outputBuffer, nullptr);
+        ctx.freeMemory(outputMemory);
+        ctx.vk.vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+        ctx.freeMemory(inputMemory);
+
+        std::cout << "Squared " << count << " floats through mapped buffers" << std::endl;
+
+        return 0;
     }
 
-    std::cout << "]" << std::endl;
+    // every element-wise variant's glslc command line, for building the library's SPIR-V
+    int printElementwiseCommands() {
+        for (const auto& op : elementwise_library::getOps()) {
+            for (auto type : op.types) {
+                std::cout << elementwise_library::getCompileCommand(op, type) << "\n";
+            }
+        }
 
-    vkUnmapMemory(ctx.device, outputMemory);
+        return 0;
+    }
 
-    vkDestroyCommandPool(ctx.device, commandPool, nullptr);
-    vkDestroyPipeline(ctx.device, pipeline, nullptr);
-    vkDestroyDescriptorPool(ctx.device, descriptorPool, nullptr);
-    vkDestroyPipelineLayout(ctx.device, pipelineLayout, nullptr);
-    vkDestroyDescriptorSetLayout(ctx.device, descriptorSetLayout, nullptr);
-    vkFreeMemory(ctx.device, outputMemory, nullptr);
-    vkDestroyBuffer(ctx.device, outputBuffer, nullptr);
-    vkFreeMemory(ctx.device, inputMemory, nullptr);
-    vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+    // every reduction variant's glslc command line, with and without subgroup operations
+    int printReductionCommands() {
+        for (auto op : {reduce_op::sum, reduce_op::min, reduce_op::max, reduce_op::dot}) {
+            for (auto type : {element_type::f32, element_type::i32, element_type::u32}) {
+                for (auto subgroup : {false, true}) {
+                    std::cout << reducer::getCompileCommand(op, type, subgroup) << "\n";
+                }
+            }
+        }
 
-    return 0;
-}
+        return 0;
+    }
 
-context::context() {
-    if (VK_SUCCESS != volkInitialize()) {
-        throw std::runtime_error("Volk could not be initialized!");
-    }
-
-    auto instanceLayers = std::vector<const char *> ();
-    auto instanceExtensions = std::vector<const char *> ();
-    auto deviceExtensions = std::vector<const char *> ();
-
-    instanceLayers.push_back("VK_LAYER_LUNARG_standard_validation");
-    instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
-    
-    VkApplicationInfo appCI {};
-    appCI.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    appCI.apiVersion = VK_MAKE_VERSION(1, 0, 2);
-    appCI.applicationVersion = 1;
-    appCI.pApplicationName = "Vulkan Compute Test";
-    appCI.pEngineName = "Vulkan Compute Test";
-    appCI.engineVersion = 1;
-
-    VkInstanceCreateInfo instanceCI {};
-    instanceCI.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    instanceCI.pApplicationInfo = &appCI;
-    instanceCI.enabledLayerCount = instanceLayers.size();
-    instanceCI.ppEnabledLayerNames = instanceLayers.data();
-    instanceCI.enabledExtensionCount = instanceExtensions.size();
-    instanceCI.ppEnabledExtensionNames = instanceExtensions.data();
-
-    vkAssert(vkCreateInstance(&instanceCI, nullptr, &instance));
-    volkLoadInstance(instance);
-
-    std::uint32_t nGPUs = 0;
-    vkAssert(vkEnumeratePhysicalDevices(instance, &nGPUs, nullptr));
-    auto pGPUs = std::make_unique<VkPhysicalDevice[]>(nGPUs);
-    vkAssert(vkEnumeratePhysicalDevices(instance, &nGPUs, pGPUs.get()));
-
-    std::uint32_t selectedGPU = 0;
-    for (std::uint32_t i = 0; i < nGPUs; i++) {
-        VkPhysicalDeviceProperties properties;
-        vkGetPhysicalDeviceProperties(pGPUs[i], &properties);
-
-        if (VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU == properties.deviceType) {
-            selectedGPU = i;
+    // every scan and compaction kernel's glslc command line
+    int printScanCommands() {
+        for (const auto& command : prefix_scan::getCompileCommands()) {
+            std::cout << command << "\n";
         }
+
+        return 0;
     }
 
-    physicalDevice = pGPUs[selectedGPU];
+    // the running sum of the inputs, then the squares of at least 100 compacted to the front
+    int runScan() {
+        context ctx;
+        elementwise_library library(ctx);
+        prefix_scan scans(ctx);
+
+        auto inputData = makeInputs();
+        auto count = static_cast<std::uint32_t> (inputData.size());
+
+        VkBufferCreateInfo bufferCI {};
+        bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferCI.size = count * sizeof(float);
+
+        VkBuffer inputBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &inputBuffer));
+        auto inputMemory = ctx.bindMemory(inputBuffer, memory_policy::upload());
+
+        VkBuffer squaresBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &squaresBuffer));
+        auto squaresMemory = ctx.bindMemory(squaresBuffer, memory_policy::gpuOnly());
+
+        VkBuffer flagsBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &flagsBuffer));
+        auto flagsMemory = ctx.bindMemory(flagsBuffer, memory_policy::gpuOnly());
+
+        VkBuffer outputBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &outputBuffer));
+        auto outputMemory = ctx.bindMemory(outputBuffer, memory_policy::readbackCached());
+
+        std::copy(inputData.begin(), inputData.end(), static_cast<float *> (inputMemory.pMapped));
+        ctx.flushMemory(inputMemory);
+
+        scans.scan(element_type::f32, inputBuffer, outputBuffer, count, false);
 
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        ctx.invalidateMemory(outputMemory);
+        printOutputs(static_cast<const float *> (outputMemory.pMapped), count);
 
-    std::uint32_t nQueueFamilies = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &nQueueFamilies, nullptr);
-    auto familyProperties = std::make_unique<VkQueueFamilyProperties[]> (nQueueFamilies);
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &nQueueFamilies, familyProperties.get());
+        // the flags go through f32 0/1 values in place before becoming the u32 flags compact() takes
+        library.dispatch("square", element_type::f32, {inputBuffer}, squaresBuffer, count);
+        library.dispatch("step", element_type::f32, {squaresBuffer}, flagsBuffer, count, {elementwise_library::toParameter(100.0F)});
+        library.dispatch("to_u32", element_type::f32, {flagsBuffer}, flagsBuffer, count);
 
-    computeQueueFamilyIds = std::vector<std::uint32_t>();
-    for (std::uint32_t i = 0; i < nQueueFamilies; i++) {
-        if (familyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-            computeQueueFamilyIds.push_back(i);
-            break;
+        auto keptCount = scans.compact(squaresBuffer, flagsBuffer, outputBuffer, count);
+
+        ctx.invalidateMemory(outputMemory);
+        printOutputs(static_cast<const float *> (outputMemory.pMapped), keptCount);
+
+        scans.forget(outputBuffer);
+        scans.forget(flagsBuffer);
+        scans.forget(squaresBuffer);
+        scans.forget(inputBuffer);
+        library.forget(flagsBuffer);
+        library.forget(squaresBuffer);
+        library.forget(inputBuffer);
+
+        ctx.vk.vkDestroyBuffer(ctx.device, outputBuffer, nullptr);
+        ctx.freeMemory(outputMemory);
+        ctx.vk.vkDestroyBuffer(ctx.device, flagsBuffer, nullptr);
+        ctx.freeMemory(flagsMemory);
+        ctx.vk.vkDestroyBuffer(ctx.device, squaresBuffer, nullptr);
+        ctx.freeMemory(squaresMemory);
+        ctx.vk.vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+        ctx.freeMemory(inputMemory);
+
+        return 0;
+    }
+
+    // every radix sort kernel's glslc command line
+    int printSortCommands() {
+        for (const auto& command : radix_sorter::getCompileCommands()) {
+            std::cout << command << "\n";
         }
+
+        return 0;
     }
 
-    if (computeQueueFamilyIds.empty()) {
-        throw std::runtime_error("GPU does not support any Compute Queues!");
+    // sorts the inputs with every other one negated, carrying each key's original index along
+    int runSort() {
+        context ctx;
+        radix_sorter sorter(ctx);
+
+        auto inputData = makeInputs();
+        auto count = static_cast<std::uint32_t> (inputData.size());
+
+        VkBufferCreateInfo bufferCI {};
+        bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferCI.size = count * sizeof(float);
+
+        // the results are read back from the same buffers, so they are cached rather than upload memory
+        VkBuffer keysBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &keysBuffer));
+        auto keysMemory = ctx.bindMemory(keysBuffer, memory_policy::readbackCached());
+
+        VkBuffer indicesBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &indicesBuffer));
+        auto indicesMemory = ctx.bindMemory(indicesBuffer, memory_policy::readbackCached());
+
+        auto pKeys = static_cast<float *> (keysMemory.pMapped);
+        auto pIndices = static_cast<std::uint32_t *> (indicesMemory.pMapped);
+
+        for (std::uint32_t i = 0; i < count; i++) {
+            pKeys[i] = 0 == i % 2 ? inputData[i] : -inputData[i];
+            pIndices[i] = i;
+        }
+
+        ctx.flushMemory(keysMemory);
+        ctx.flushMemory(indicesMemory);
+
+        sorter.sort(element_type::f32, keysBuffer, count, indicesBuffer);
+
+        ctx.invalidateMemory(keysMemory);
+        ctx.invalidateMemory(indicesMemory);
+        printOutputs(pKeys, count);
+
+        std::cout << "Indices: [";
+
+        for (std::uint32_t i = 0; i < count; i++) {
+            std::cout << pIndices[i];
+
+            if (i != count - 1) {
+                std::cout << ", ";
+            }
+        }
+
+        std::cout << "]" << std::endl;
+
+        sorter.forget(indicesBuffer);
+        sorter.forget(keysBuffer);
+
+        ctx.vk.vkDestroyBuffer(ctx.device, indicesBuffer, nullptr);
+        ctx.freeMemory(indicesMemory);
+        ctx.vk.vkDestroyBuffer(ctx.device, keysBuffer, nullptr);
+        ctx.freeMemory(keysMemory);
+
+        return 0;
     }
 
-    // using the first Compute Family Id; can modify to select multiple...
-    auto queueCIs = std::vector<VkDeviceQueueCreateInfo>();
-    auto queuePriorities = std::vector<float> ();
+    // sum, min, max and the dot product with itself of the inputs; only the scalars come back
+    int runReductions() {
+        context ctx;
+        reducer reductions(ctx);
+
+        auto inputData = makeInputs();
+        auto count = static_cast<std::uint32_t> (inputData.size());
+
+        VkBufferCreateInfo bufferCI {};
+        bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferCI.size = count * sizeof(float);
+
+        VkBuffer inputBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &inputBuffer));
+        auto inputMemory = ctx.bindMemory(inputBuffer, memory_policy::upload());
+
+        std::copy(inputData.begin(), inputData.end(), static_cast<float *> (inputMemory.pMapped));
+        ctx.flushMemory(inputMemory);
+
+        std::cout << (ctx.subgroupArithmetic ? "Reducing with subgroup operations\n" : "Reducing through shared memory\n");
 
-    {
-        queuePriorities.push_back(1.0F);
+        for (auto op : {reduce_op::sum, reduce_op::min, reduce_op::max, reduce_op::dot}) {
+            auto second = reduce_op::dot == op ? inputBuffer : VK_NULL_HANDLE;
 
-        VkDeviceQueueCreateInfo queueCI {};
-        queueCI.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCI.queueCount = queuePriorities.size();
-        queueCI.pQueuePriorities = queuePriorities.data();
+            std::cout << reducer::getOpName(op) << ": " << reducer::toFloat(reductions.reduce(op, element_type::f32, inputBuffer, count, second)) << "\n";
+        }
+
+        reductions.forget(inputBuffer);
+
+        ctx.vk.vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+        ctx.freeMemory(inputMemory);
 
-        queueCIs.push_back(queueCI);
+        return 0;
     }
 
-    VkDeviceCreateInfo deviceCI {};
-    deviceCI.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCI.queueCreateInfoCount = queueCIs.size();
-    deviceCI.pQueueCreateInfos = queueCIs.data();
-    deviceCI.enabledExtensionCount = deviceExtensions.size();
-    deviceCI.ppEnabledExtensionNames = deviceExtensions.data();
+    // clamp(0.5 * x * x + x, 0, 100) as a chain of library kernels, without leaving the device between
+    // them, or with fused set as a single kernel generated for the whole chain
+    int runElementwise(bool fused) {
+        context ctx;
+        elementwise_library library(ctx);
+        elementwise_fuser fuser(ctx);
+
+        auto inputData = makeInputs();
+        auto count = static_cast<std::uint32_t> (inputData.size());
+
+        VkBufferCreateInfo bufferCI {};
+        bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferCI.size = count * sizeof(float);
+
+        VkBuffer inputBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &inputBuffer));
+        auto inputMemory = ctx.bindMemory(inputBuffer, memory_policy::upload());
+
+        VkBuffer scratchBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &scratchBuffer));
+        auto scratchMemory = ctx.bindMemory(scratchBuffer, memory_policy::gpuOnly());
+
+        VkBuffer outputBuffer = VK_NULL_HANDLE;
+        vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &outputBuffer));
+        auto outputMemory = ctx.bindMemory(outputBuffer, memory_policy::readbackCached());
+
+        std::copy(inputData.begin(), inputData.end(), static_cast<float *> (inputMemory.pMapped));
+        ctx.flushMemory(inputMemory);
+
+        if (fused) {
+            // one generated kernel: the input is read once and the output written once
+            auto x = elementwise_expression::input(0, element_type::f32);
+            auto y = x.apply("square")
+                    .apply("axpy", {x}, {elementwise_library::toParameter(0.5F)})
+                    .apply("clamp", {}, {elementwise_library::toParameter(0.0F), elementwise_library::toParameter(100.0F)});
+
+            fuser.dispatch(y, {inputBuffer}, outputBuffer, count);
+        } else {
+            library.dispatch("square", element_type::f32, {inputBuffer}, scratchBuffer, count);
+            library.dispatch("axpy", element_type::f32, {scratchBuffer, inputBuffer}, outputBuffer, count, {elementwise_library::toParameter(0.5F)});
+            library.dispatch("clamp", element_type::f32, {outputBuffer}, outputBuffer, count, {elementwise_library::toParameter(0.0F), elementwise_library::toParameter(100.0F)});
+        }
 
-    vkAssert(vkCreateDevice(physicalDevice, &deviceCI, nullptr, &device));
-    volkLoadDevice(device);
-}
+        ctx.invalidateMemory(outputMemory);
+        printOutputs(static_cast<const float *> (outputMemory.pMapped), count);
+
+        library.forget(outputBuffer);
+        library.forget(scratchBuffer);
+        library.forget(inputBuffer);
+        fuser.forget(outputBuffer);
+        fuser.forget(inputBuffer);
 
-context::~context() {
-    vkDestroyDevice(device, nullptr);
-    vkDestroyInstance(instance, nullptr);
+        ctx.vk.vkDestroyBuffer(ctx.device, outputBuffer, nullptr);
+        ctx.freeMemory(outputMemory);
+        ctx.vk.vkDestroyBuffer(ctx.device, scratchBuffer, nullptr);
+        ctx.freeMemory(scratchMemory);
+        ctx.vk.vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+        ctx.freeMemory(inputMemory);
+
+        return 0;
+    }
 }
 
-VkDeviceMemory context::bindMemory(VkBuffer buffer) {
-    VkMemoryRequirements memReqs;
-    vkGetBufferMemoryRequirements(device, buffer, &memReqs);
+int main(int argc, char** argv) {
+    auto args = std::vector<std::string> (argv + 1, argv + argc);
 
-    VkMemoryAllocateInfo allocInfo {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memReqs.size;
-    allocInfo.memoryTypeIndex = getMemoryTypeIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    // this mode builds one context per device on a shared instance instead of the default context
+    if (std::find(args.begin(), args.end(), "--multi-gpu") != args.end()) {
+        return squareOnAllDevices();
+    }
 
-    VkDeviceMemory memory;
-    vkAssert(vkAllocateMemory(device, &allocInfo, nullptr, &memory));
+    if (std::find(args.begin(), args.end(), "--forget-cycles") != args.end()) {
+        return checkForgetCycles();
+    }
 
-    vkAssert(vkBindBufferMemory(device, buffer, memory, 0));
+    if (std::find(args.begin(), args.end(), "--elementwise-commands") != args.end()) {
+        return printElementwiseCommands();
+    }
 
-    return memory;
-}
+    if (std::find(args.begin(), args.end(), "--reduction-commands") != args.end()) {
+        return printReductionCommands();
+    }
 
-std::uint32_t context::getMemoryTypeIndex(std::uint32_t typeBits, unsigned int requirementsMask) {
-    for (std::uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
-        if (0 != (typeBits & (1 << i))) {
-            if (memoryProperties.memoryTypes[i].propertyFlags & requirementsMask) {
-                return i;
-            }
+    if (std::find(args.begin(), args.end(), "--scan-commands") != args.end()) {
+        return printScanCommands();
+    }
+
+    if (std::find(args.begin(), args.end(), "--scan") != args.end()) {
+        return runScan();
+    }
+
+    if (std::find(args.begin(), args.end(), "--sort-commands") != args.end()) {
+        return printSortCommands();
+    }
+
+    if (std::find(args.begin(), args.end(), "--sort") != args.end()) {
+        return runSort();
+    }
+
+    if (std::find(args.begin(), args.end(), "--reduce") != args.end()) {
+        return runReductions();
+    }
+
+    if (std::find(args.begin(), args.end(), "--elementwise") != args.end()) {
+        return runElementwise(false);
+    }
+
+    if (std::find(args.begin(), args.end(), "--fused") != args.end()) {
+        return runElementwise(true);
+    }
+
+    auto inputArg = std::find(args.begin(), args.end(), "--input");
+    auto outputArg = std::find(args.begin(), args.end(), "--output");
+
+    if (inputArg != args.end() && inputArg + 1 != args.end() && outputArg != args.end() && outputArg + 1 != args.end()) {
+        return squareFile(*(inputArg + 1), *(outputArg + 1));
+    }
+
+    auto threadsArg = std::find(args.begin(), args.end(), "--threads");
+
+    if (threadsArg != args.end() && threadsArg + 1 != args.end()) {
+        const auto& value = *(threadsArg + 1);
+        char * pEnd = nullptr;
+
+        errno = 0;
+        auto threadCount = std::strtoul(value.c_str(), &pEnd, 10);
+
+        // strtoul takes "-1" as a huge count, so only plain digits are accepted
+        if (value.empty() || !std::isdigit(static_cast<unsigned char> (value[0])) || '\0' != *pEnd || ERANGE == errno || 0 == threadCount || threadCount > UINT32_MAX) {
+            std::cerr << "Usage: --threads N, where N is a positive number of threads\n";
+            return 1;
         }
+
+        return squareOnThreads(static_cast<std::uint32_t> (threadCount));
     }
 
-    throw std::runtime_error("No MemoryType exists with the requested features!");
-}
+    context ctx;
 
-std::string translateVulkanResult(VkResult result) {
-    switch (result) {
-        // Success codes
-        case VK_SUCCESS:
-            return "Command successfully completed.";
-        case VK_NOT_READY:
-            return "A fence or query has not yet completed.";
-        case VK_TIMEOUT:
-            return "A wait operation has not completed in the specified time.";
-        case VK_EVENT_SET:
-            return "An event is signaled.";
-        case VK_EVENT_RESET:
-            return "An event is unsignaled.";
-        case VK_INCOMPLETE:
-            return "A return array was too small for the result.";
-        case VK_SUBOPTIMAL_KHR:
-            return "A swapchain no longer matches the surface properties exactly, but can still be used to present to the surface successfully.";
-
-        // Error codes
-        case VK_ERROR_OUT_OF_HOST_MEMORY:
-            return "A host memory allocation has failed.";
-        case VK_ERROR_OUT_OF_DEVICE_MEMORY:
-            return "A device memory allocation has failed.";
-        case VK_ERROR_INITIALIZATION_FAILED:
-            return "Initialization of an object could not be completed for implementation-specific reasons.";
-        case VK_ERROR_DEVICE_LOST:
-            return "The logical or physical device has been lost.";
-        case VK_ERROR_MEMORY_MAP_FAILED:
-            return "Mapping of a memory object has failed.";
-        case VK_ERROR_LAYER_NOT_PRESENT:
-            return "A requested layer is not present or could not be loaded.";
-        case VK_ERROR_EXTENSION_NOT_PRESENT:
-            return "A requested extension is not supported.";
-        case VK_ERROR_FEATURE_NOT_PRESENT:
-            return "A requested feature is not supported.";
-        case VK_ERROR_INCOMPATIBLE_DRIVER:
-            return "The requested version of Vulkan is not supported by the driver or is otherwise incompatible for implementation-specific reasons.";
-        case VK_ERROR_TOO_MANY_OBJECTS:
-            return "Too many objects of the type have already been created.";
-        case VK_ERROR_FORMAT_NOT_SUPPORTED:
-            return "A requested format is not supported on this device.";
-        case VK_ERROR_SURFACE_LOST_KHR:
-            return "A surface is no longer available.";
-        case VK_ERROR_NATIVE_WINDOW_IN_USE_KHR:
-            return "The requested window is already connected to a VkSurfaceKHR, or to some other non-Vulkan API.";
-        case VK_ERROR_OUT_OF_DATE_KHR:
-            return "A surface has changed in such a way that it is no longer compatible with the swapchain, and further presentation requests using the "
-                    "swapchain will fail. Applications must query the new surface properties and recreate their swapchain if they wish to continue"
-                    "presenting to the surface.";
-        case VK_ERROR_INCOMPATIBLE_DISPLAY_KHR:
-            return "The display used by a swapchain does not use the same presentable image layout, or is incompatible in a way that prevents sharing an"
-            " image.";
-        case VK_ERROR_VALIDATION_FAILED_EXT:
-            return "A validation layer found an error.";
-        default: {
-            auto msg = std::stringstream();
-
-            msg << "Unknown VkResult: 0x" << std::hex << result;
-
-            return msg.str();
+    // discrete GPUs keep the storage buffers in DEVICE_LOCAL memory and stage transfers;
+    // UMA devices (or --host-visible) let the shader work on host-visible memory directly.
+    bool useDeviceLocal = !ctx.isUnifiedMemory();
+    bool profile = false;
+    bool useDeviceAddress = false;
+
+    for (const auto& arg : args) {
+        if ("--device-local" == arg) {
+            useDeviceLocal = true;
+        } else if ("--host-visible" == arg) {
+            useDeviceLocal = false;
+        } else if ("--profile" == arg) {
+            profile = true;
+        } else if ("--device-address" == arg) {
+            useDeviceAddress = true;
         }
     }
-}
 
-void vkAssert(VkResult result) {
-    if (VK_SUCCESS != result) {
-        throw std::runtime_error(translateVulkanResult(result));
+    if (useDeviceAddress && !ctx.bufferDeviceAddress) {
+        std::cerr << "VK_KHR_buffer_device_address is not available, binding descriptors instead\n";
+        useDeviceAddress = false;
     }
-}
 
-std::vector<char> readFile(const std::string& fileName) {
-    std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    auto inputData = makeInputs();
 
-    if (file.is_open()) {
-        auto size = file.tellg();
-        auto out = std::vector<char>();
-        
-        out.resize(size);
+    VkBufferCreateInfo bufferCI {};
+    bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferCI.size = inputData.size() * sizeof(float);
 
-        file.seekg(0, std::ios::beg);
-        file.read(out.data(), size);
-        file.close();
+    // uploads and readbacks may run on a dedicated transfer family, so the buffers are shared
+    ctx.shareAcrossQueueFamilies(bufferCI);
 
-        return out;
+    if (useDeviceAddress) {
+        ctx.enableDeviceAddress(bufferCI);
     }
 
-    throw std::runtime_error("Unable to open file: " + fileName);
+    queue_scheduler scheduler(ctx);
+
+    auto inputPolicy = memory_policy::upload();
+    auto outputPolicy = memory_policy::readbackCached();
+    auto stagingRing = std::unique_ptr<staging_ring>();
+
+    if (useDeviceLocal) {
+        bufferCI.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        inputPolicy = memory_policy::gpuOnly();
+        outputPolicy = memory_policy::gpuOnly();
+        stagingRing = std::make_unique<staging_ring> (ctx, staging_ring::DEFAULT_CAPACITY, scheduler.getTransferQueueFamilyIndex());
+    }
+
+    VkBuffer inputBuffer = VK_NULL_HANDLE;
+    vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &inputBuffer));
+    auto inputMemory = ctx.bindMemory(inputBuffer, inputPolicy);
+
+    if (!useDeviceLocal) {
+        std::copy(inputData.begin(), inputData.end(), static_cast<float *> (inputMemory.pMapped));
+        ctx.flushMemory(inputMemory);
+    }
+
+    VkBuffer outputBuffer = VK_NULL_HANDLE;
+    vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &outputBuffer));
+    auto outputMemory = ctx.bindMemory(outputBuffer, outputPolicy);
+
+    // seeded from the previous run if it was produced by this device and driver; saved on exit
+    pipeline_cache pipelineCache(ctx, "pipeline.cache");
+
+    auto profiler = std::unique_ptr<gpu_profiler>();
+
+    if (profile) {
+        profiler = std::make_unique<gpu_profiler> (ctx, ctx.computeQueueFamilyIds[0]);
+        ctx.profiler = profiler.get();
+    }
+
+    // the kernel squares one vec4 per invocation; the first invocations also take one float of the tail each
+    auto workgroupSize = ctx.getPreferredWorkgroupSize();
+    auto invocationCount = std::max(inputData.size() / 4, inputData.size() % 4);
+
+    auto groupCount = ctx.getGroupCount(invocationCount, workgroupSize);
+    auto kernelBuffers = std::vector<VkBuffer> ();
+    auto parameters = std::vector<std::uint32_t> ();
+    auto pSquareKernel = std::unique_ptr<compute_kernel> ();
+
+    if (useDeviceAddress) {
+        // no bindings: input address, output address and element count are the push constants
+        pushAddress(parameters, ctx.getDeviceAddress(inputBuffer));
+        pushAddress(parameters, ctx.getDeviceAddress(outputBuffer));
+        parameters.push_back(static_cast<std::uint32_t> (inputData.size()));
+
+        pSquareKernel = std::make_unique<compute_kernel> (ctx, "square", readFile("square_address.comp.spv"), 0, pipelineCache.cache, std::vector<std::uint32_t> {workgroupSize}, 5);
+    } else {
+        // vec4 views at bindings 0 and 1, float views of the same buffers at 2 and 3; the element
+        // count is the only push constant
+        kernelBuffers = {inputBuffer, outputBuffer, inputBuffer, outputBuffer};
+        parameters.push_back(static_cast<std::uint32_t> (inputData.size()));
+
+        pSquareKernel = std::make_unique<compute_kernel> (ctx, "square", readFile("square.comp.spv"), 4, pipelineCache.cache, std::vector<std::uint32_t> {workgroupSize}, 1);
+    }
+
+    auto& squareKernel = *pSquareKernel;
+
+    const float * pStagedResults = nullptr;
+
+    if (useDeviceLocal && scheduler.hasDedicatedTransfer()) {
+        // copies run on the DMA queue; each stage waits for the previous one on the host
+        auto upload = scheduler.submitTransfer([&](VkCommandBuffer commandBuffer) {
+            stagingRing->upload(commandBuffer, inputBuffer, 0, inputData.data(), inputData.size() * sizeof(float));
+        });
+
+        stagingRing->endBatch(upload);
+        upload.wait();
+
+        squareKernel.submit(scheduler.computeQueue(), kernelBuffers, groupCount, parameters).wait();
+
+        auto readback = scheduler.submitTransfer([&](VkCommandBuffer commandBuffer) {
+            pStagedResults = static_cast<const float *> (stagingRing->readback(commandBuffer, outputBuffer, 0, inputData.size() * sizeof(float)));
+        });
+
+        stagingRing->endBatch(readback);
+        readback.wait();
+    } else if (useDeviceLocal) {
+        squareKernel.beginRecording();
+
+        auto job = scheduler.submitCompute([&](VkCommandBuffer commandBuffer) {
+            stagingRing->upload(commandBuffer, inputBuffer, 0, inputData.data(), inputData.size() * sizeof(float));
+            squareKernel.record(commandBuffer, kernelBuffers, groupCount, parameters);
+            pStagedResults = static_cast<const float *> (stagingRing->readback(commandBuffer, outputBuffer, 0, inputData.size() * sizeof(float)));
+        });
+
+        squareKernel.endRecording(job);
+        stagingRing->endBatch(job);
+        job.wait();
+    } else {
+        squareKernel.submit(scheduler.computeQueue(), kernelBuffers, groupCount, parameters).wait();
+    }
+
+    if (profile) {
+        profiler->collect();
+    }
+
+    const float * pResults = pStagedResults;
+
+    if (!useDeviceLocal) {
+        ctx.invalidateMemory(outputMemory);
+        pResults = static_cast<const float *> (outputMemory.pMapped);
+    }
+
+    printOutputs(pResults, inputData.size());
+
+    if (profile) {
+        profiler->report(std::cout);
+    }
+
+    ctx.vk.vkDestroyBuffer(ctx.device, outputBuffer, nullptr);
+    ctx.freeMemory(outputMemory);
+    ctx.vk.vkDestroyBuffer(ctx.device, inputBuffer, nullptr);
+    ctx.freeMemory(inputMemory);
+    stagingRing.reset();
+
+    return 0;
 }
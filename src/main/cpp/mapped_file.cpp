@@ -0,0 +1,201 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    std::uint64_t alignUp(std::uint64_t value, std::uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+mapped_file::mapped_file(const std::string& path, std::uint64_t size, bool output) : path(path), pData(nullptr), size(size), mappedSize(alignUp(size, getPageSize())), output(output) {
+}
+
+mapped_file::mapped_file(mapped_file&& other) : path(other.path), pData(other.pData), size(other.size), mappedSize(other.mappedSize), output(other.output) {
+    other.pData = nullptr;
+}
+
+void * mapped_file::getData() const {
+    return pData;
+}
+
+std::uint64_t mapped_file::getSize() const {
+    return size;
+}
+
+std::uint64_t mapped_file::getMappedSize() const {
+    return mappedSize;
+}
+
+#if defined(_WIN32)
+
+std::uint64_t mapped_file::getPageSize() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    return info.dwPageSize;
+}
+
+mapped_file mapped_file::openInput(const std::string& path) {
+    auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (INVALID_HANDLE_VALUE == file) {
+        throw std::runtime_error("Could not open " + path + "!");
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+
+    if (0 == fileSize.QuadPart) {
+        CloseHandle(file);
+        throw std::runtime_error(path + " is empty!");
+    }
+
+    auto mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (nullptr == mapping) {
+        throw std::runtime_error("Could not map " + path + "!");
+    }
+
+    auto mapped = mapped_file(path, fileSize.QuadPart, false);
+    mapped.pData = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (nullptr == mapped.pData) {
+        throw std::runtime_error("Could not map " + path + "!");
+    }
+
+    return mapped;
+}
+
+mapped_file mapped_file::createOutput(const std::string& path, std::uint64_t size) {
+    auto file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (INVALID_HANDLE_VALUE == file) {
+        throw std::runtime_error("Could not create " + path + "!");
+    }
+
+    auto mapped = mapped_file(path, size, true);
+    auto mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD> (mapped.mappedSize >> 32), static_cast<DWORD> (mapped.mappedSize), nullptr);
+    CloseHandle(file);
+
+    if (nullptr == mapping) {
+        throw std::runtime_error("Could not map " + path + "!");
+    }
+
+    mapped.pData = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (nullptr == mapped.pData) {
+        throw std::runtime_error("Could not map " + path + "!");
+    }
+
+    return mapped;
+}
+
+mapped_file::~mapped_file() {
+    if (nullptr == pData) {
+        return;
+    }
+
+    UnmapViewOfFile(pData);
+
+    if (output && mappedSize != size) {
+        auto file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (INVALID_HANDLE_VALUE != file) {
+            LARGE_INTEGER end;
+            end.QuadPart = size;
+
+            SetFilePointerEx(file, end, nullptr, FILE_BEGIN);
+            SetEndOfFile(file);
+            CloseHandle(file);
+        }
+    }
+}
+
+#else
+
+std::uint64_t mapped_file::getPageSize() {
+    return sysconf(_SC_PAGESIZE);
+}
+
+mapped_file mapped_file::openInput(const std::string& path) {
+    auto fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        throw std::runtime_error("Could not open " + path + "!");
+    }
+
+    struct stat info;
+
+    if (0 != fstat(fd, &info) || 0 == info.st_size) {
+        close(fd);
+        throw std::runtime_error(path + " is empty or unreadable!");
+    }
+
+    auto mapped = mapped_file(path, info.st_size, false);
+    auto pData = mmap(nullptr, mapped.mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == pData) {
+        throw std::runtime_error("Could not map " + path + "!");
+    }
+
+    mapped.pData = pData;
+
+    return mapped;
+}
+
+mapped_file mapped_file::createOutput(const std::string& path, std::uint64_t size) {
+    auto fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        throw std::runtime_error("Could not create " + path + "!");
+    }
+
+    auto mapped = mapped_file(path, size, true);
+
+    // whole pages, so every mapped byte is backed by the file
+    if (0 != ftruncate(fd, mapped.mappedSize)) {
+        close(fd);
+        throw std::runtime_error("Could not resize " + path + "!");
+    }
+
+    auto pData = mmap(nullptr, mapped.mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == pData) {
+        throw std::runtime_error("Could not map " + path + "!");
+    }
+
+    mapped.pData = pData;
+
+    return mapped;
+}
+
+mapped_file::~mapped_file() {
+    if (nullptr == pData) {
+        return;
+    }
+
+    munmap(pData, mappedSize);
+
+    if (output && mappedSize != size) {
+        if (0 != truncate(path.c_str(), size)) {
+            // nothing sensible to do about it in a destructor; the file just keeps its padding
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,427 @@
+#include "memory_arena.hpp"
+
+#include "util.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // true if the last byte of resource A and the first byte of resource B share a granularity page
+    bool onSamePage(VkDeviceSize aOffset, VkDeviceSize aSize, VkDeviceSize bOffset, VkDeviceSize granularity) {
+        auto aEndPage = (aOffset + aSize - 1) & ~(granularity - 1);
+        auto bStartPage = bOffset & ~(granularity - 1);
+
+        return aEndPage == bStartPage;
+    }
+}
+
+double memory_arena_statistics::fragmentation() const {
+    if (0 == freeBytes) {
+        return 0.0;
+    }
+
+    return 1.0 - static_cast<double> (largestFreeRange) / static_cast<double> (freeBytes);
+}
+
+memory_arena::memory_arena(VkDevice device, const VolkDeviceTable& vk, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits, VkDeviceSize blockSize, VkFlags allocateFlags) : vk(vk) {
+    this->device = device;
+    this->memoryProperties = memoryProperties;
+    this->bufferImageGranularity = std::max<VkDeviceSize> (1, limits.bufferImageGranularity);
+    this->nonCoherentAtomSize = std::max<VkDeviceSize> (1, limits.nonCoherentAtomSize);
+    this->maxMemoryAllocationCount = limits.maxMemoryAllocationCount;
+    this->deviceAllocationCount = 0;
+    this->blockSize = blockSize;
+    this->allocateFlags = allocateFlags;
+}
+
+memory_arena::~memory_arena() {
+    for (auto& typeBlocks : blocks) {
+        for (auto& pBlock : typeBlocks) {
+            if (nullptr != pBlock->pMapped) {
+                vk.vkUnmapMemory(device, pBlock->memory);
+            }
+
+            vk.vkFreeMemory(device, pBlock->memory, nullptr);
+        }
+    }
+}
+
+memory_allocation memory_arena::allocate(const VkMemoryRequirements& requirements, std::uint32_t memoryTypeIndex, resource_kind kind) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto alignment = std::max<VkDeviceSize> (1, requirements.alignment);
+    auto size = getPaddedSize(requirements.size, memoryTypeIndex);
+    auto allocation = memory_allocation();
+
+    if (isNonCoherent(memoryTypeIndex)) {
+        alignment = std::max(alignment, nonCoherentAtomSize);
+    }
+
+    auto preferredBlockSize = getPreferredBlockSize(memoryTypeIndex);
+
+    // large requests would waste most of a shared block; give them their own VkDeviceMemory
+    if (size > preferredBlockSize / 2) {
+        auto pBlock = createBlock(memoryTypeIndex, size, true);
+
+        pBlock->tryAllocate(size, alignment, bufferImageGranularity, kind, allocation);
+
+        return allocation;
+    }
+
+    for (auto& pBlock : blocks[memoryTypeIndex]) {
+        if (!pBlock->dedicated && pBlock->tryAllocate(size, alignment, bufferImageGranularity, kind, allocation)) {
+            return allocation;
+        }
+    }
+
+    auto pBlock = createBlock(memoryTypeIndex, preferredBlockSize, false);
+
+    if (!pBlock->tryAllocate(size, alignment, bufferImageGranularity, kind, allocation)) {
+        throw std::runtime_error("Allocation does not fit in a new memory block!");
+    }
+
+    return allocation;
+}
+
+void memory_arena::free(const memory_allocation& allocation) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (nullptr == allocation.block) {
+        return;
+    }
+
+    auto pBlock = static_cast<block *> (allocation.block);
+
+    pBlock->release(allocation.offset);
+
+    if (0 != pBlock->allocationCount) {
+        return;
+    }
+
+    if (pBlock->dedicated) {
+        destroyBlock(allocation.memoryTypeIndex, pBlock);
+        return;
+    }
+
+    // keep a single empty block per memory type around so alloc/free cycles do not thrash the driver
+    auto& typeBlocks = blocks[allocation.memoryTypeIndex];
+    auto emptyBlocks = std::count_if(typeBlocks.begin(), typeBlocks.end(), [](const std::unique_ptr<block>& b) {
+        return !b->dedicated && 0 == b->allocationCount;
+    });
+
+    if (emptyBlocks > 1) {
+        destroyBlock(allocation.memoryTypeIndex, pBlock);
+    }
+}
+
+void memory_arena::flush(const memory_allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const {
+    if (!isNonCoherent(allocation.memoryTypeIndex)) {
+        return;
+    }
+
+    auto range = getMappedRange(allocation, offset, size);
+
+    vkAssert(vk.vkFlushMappedMemoryRanges(device, 1, &range));
+}
+
+void memory_arena::invalidate(const memory_allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const {
+    if (!isNonCoherent(allocation.memoryTypeIndex)) {
+        return;
+    }
+
+    auto range = getMappedRange(allocation, offset, size);
+
+    vkAssert(vk.vkInvalidateMappedMemoryRanges(device, 1, &range));
+}
+
+bool memory_arena::isNonCoherent(std::uint32_t memoryTypeIndex) const {
+    auto flags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+    return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && 0 == (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+VkDeviceSize memory_arena::getPaddedSize(VkDeviceSize size, std::uint32_t memoryTypeIndex) const {
+    return isNonCoherent(memoryTypeIndex) ? alignUp(size, nonCoherentAtomSize) : size;
+}
+
+VkDeviceSize memory_arena::getPreferredBlockSize(std::uint32_t memoryTypeIndex) const {
+    auto heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+
+    return std::min(blockSize, std::max<VkDeviceSize> (heapSize / 8, 1));
+}
+
+VkMappedMemoryRange memory_arena::getMappedRange(const memory_allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const {
+    auto begin = allocation.offset + offset;
+    auto end = VK_WHOLE_SIZE == size ? allocation.offset + allocation.size : begin + size;
+
+    // the allocation itself starts and ends on atom boundaries, so the widened range stays inside it
+    begin = begin / nonCoherentAtomSize * nonCoherentAtomSize;
+    end = alignUp(end, nonCoherentAtomSize);
+
+    VkMappedMemoryRange range {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation.memory;
+    range.offset = begin;
+    range.size = end - begin;
+
+    return range;
+}
+
+memory_arena_statistics memory_arena::getStatistics(std::uint32_t memoryTypeIndex) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return collectStatistics(memoryTypeIndex);
+}
+
+memory_arena_statistics memory_arena::getStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto total = memory_arena_statistics();
+
+    for (std::uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        auto stats = collectStatistics(i);
+
+        total.blockCount += stats.blockCount;
+        total.allocationCount += stats.allocationCount;
+        total.freeRangeCount += stats.freeRangeCount;
+        total.blockBytes += stats.blockBytes;
+        total.usedBytes += stats.usedBytes;
+        total.freeBytes += stats.freeBytes;
+        total.largestFreeRange = std::max(total.largestFreeRange, stats.largestFreeRange);
+    }
+
+    return total;
+}
+
+std::vector<VkDeviceSize> memory_arena::getHeapBlockBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto heapBytes = std::vector<VkDeviceSize> (memoryProperties.memoryHeapCount);
+
+    for (std::uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        for (const auto& pBlock : blocks[i]) {
+            heapBytes[memoryProperties.memoryTypes[i].heapIndex] += pBlock->size;
+        }
+    }
+
+    return heapBytes;
+}
+
+VkDeviceSize memory_arena::getNewBlockBytes(VkDeviceSize size, std::uint32_t memoryTypeIndex) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size = getPaddedSize(size, memoryTypeIndex);
+
+    auto preferredBlockSize = getPreferredBlockSize(memoryTypeIndex);
+
+    // mirrors allocate(), ignoring alignment
+    if (size > preferredBlockSize / 2) {
+        return size;
+    }
+
+    for (const auto& pBlock : blocks[memoryTypeIndex]) {
+        if (pBlock->dedicated) {
+            continue;
+        }
+
+        for (const auto& entry : pBlock->ranges) {
+            if (entry.second.free && entry.second.size >= size) {
+                return 0;
+            }
+        }
+    }
+
+    return preferredBlockSize;
+}
+
+memory_arena_statistics memory_arena::collectStatistics(std::uint32_t memoryTypeIndex) const {
+    auto stats = memory_arena_statistics();
+
+    for (const auto& pBlock : blocks[memoryTypeIndex]) {
+        stats.blockCount++;
+        stats.allocationCount += pBlock->allocationCount;
+        stats.blockBytes += pBlock->size;
+
+        for (const auto& entry : pBlock->ranges) {
+            if (entry.second.free) {
+                stats.freeRangeCount++;
+                stats.freeBytes += entry.second.size;
+                stats.largestFreeRange = std::max(stats.largestFreeRange, entry.second.size);
+            } else {
+                stats.usedBytes += entry.second.size;
+            }
+        }
+    }
+
+    return stats;
+}
+
+memory_arena::block * memory_arena::createBlock(std::uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated) {
+    if (deviceAllocationCount >= maxMemoryAllocationCount) {
+        throw std::runtime_error("maxMemoryAllocationCount exceeded!");
+    }
+
+    VkMemoryAllocateInfo allocInfo {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+#if defined(VK_KHR_device_group)
+    VkMemoryAllocateFlagsInfoKHR allocFlagsInfo {};
+    allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    allocFlagsInfo.flags = allocateFlags;
+
+    if (0 != allocateFlags) {
+        allocInfo.pNext = &allocFlagsInfo;
+    }
+#endif
+
+    auto pBlock = std::make_unique<block> ();
+    vkAssert(vk.vkAllocateMemory(device, &allocInfo, nullptr, &pBlock->memory));
+
+    pBlock->size = size;
+    pBlock->memoryTypeIndex = memoryTypeIndex;
+    pBlock->allocationCount = 0;
+    pBlock->dedicated = dedicated;
+    pBlock->pMapped = nullptr;
+    pBlock->ranges[0] = range {size, true, resource_kind::linear};
+
+    if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void * pMapped = nullptr;
+        auto result = vk.vkMapMemory(device, pBlock->memory, 0, VK_WHOLE_SIZE, 0, &pMapped);
+
+        if (VK_SUCCESS != result) {
+            vk.vkFreeMemory(device, pBlock->memory, nullptr);
+            vkAssert(result);
+        }
+
+        pBlock->pMapped = static_cast<char *> (pMapped);
+    }
+
+    deviceAllocationCount++;
+
+    blocks[memoryTypeIndex].push_back(std::move(pBlock));
+
+    return blocks[memoryTypeIndex].back().get();
+}
+
+void memory_arena::destroyBlock(std::uint32_t memoryTypeIndex, block * pBlock) {
+    auto& typeBlocks = blocks[memoryTypeIndex];
+    auto it = std::find_if(typeBlocks.begin(), typeBlocks.end(), [pBlock](const std::unique_ptr<block>& b) {
+        return b.get() == pBlock;
+    });
+
+    if (nullptr != pBlock->pMapped) {
+        vk.vkUnmapMemory(device, pBlock->memory);
+    }
+
+    vk.vkFreeMemory(device, pBlock->memory, nullptr);
+    deviceAllocationCount--;
+
+    typeBlocks.erase(it);
+}
+
+bool memory_arena::block::tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize granularity, resource_kind kind, memory_allocation& out) {
+    auto best = ranges.end();
+    VkDeviceSize bestStart = 0;
+
+    // best-fit over the free ranges keeps large holes intact for large requests
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+        if (!it->second.free || it->second.size < size) {
+            continue;
+        }
+
+        auto rangeOffset = it->first;
+        auto rangeEnd = rangeOffset + it->second.size;
+        auto start = alignUp(rangeOffset, alignment);
+
+        if (granularity > 1 && it != ranges.begin()) {
+            auto prev = std::prev(it);
+
+            if (!prev->second.free && prev->second.kind != kind && onSamePage(prev->first, prev->second.size, start, granularity)) {
+                start = alignUp(start, granularity);
+            }
+        }
+
+        if (start + size > rangeEnd) {
+            continue;
+        }
+
+        if (granularity > 1) {
+            auto next = std::next(it);
+
+            if (next != ranges.end() && !next->second.free && next->second.kind != kind && onSamePage(start, size, next->first, granularity)) {
+                continue;
+            }
+        }
+
+        if (best == ranges.end() || it->second.size < best->second.size) {
+            best = it;
+            bestStart = start;
+        }
+    }
+
+    if (best == ranges.end()) {
+        return false;
+    }
+
+    auto rangeOffset = best->first;
+    auto rangeEnd = rangeOffset + best->second.size;
+
+    // split into [padding][allocation][remainder]; padding stays free and is reusable by smaller requests
+    if (bestStart > rangeOffset) {
+        best->second.size = bestStart - rangeOffset;
+    } else {
+        ranges.erase(best);
+    }
+
+    ranges[bestStart] = range {size, false, kind};
+
+    if (bestStart + size < rangeEnd) {
+        ranges[bestStart + size] = range {rangeEnd - bestStart - size, true, resource_kind::linear};
+    }
+
+    allocationCount++;
+
+    out.memory = memory;
+    out.offset = bestStart;
+    out.size = size;
+    out.memoryTypeIndex = memoryTypeIndex;
+    out.block = this;
+    out.pMapped = nullptr != pMapped ? pMapped + bestStart : nullptr;
+
+    return true;
+}
+
+void memory_arena::block::release(VkDeviceSize offset) {
+    auto it = ranges.find(offset);
+
+    if (it == ranges.end() || it->second.free) {
+        throw std::runtime_error("Freed memory that was not allocated from this block!");
+    }
+
+    it->second.free = true;
+    allocationCount--;
+
+    // coalesce with the following free range
+    auto next = std::next(it);
+    if (next != ranges.end() && next->second.free) {
+        it->second.size += next->second.size;
+        ranges.erase(next);
+    }
+
+    // coalesce with the preceding free range
+    if (it != ranges.begin()) {
+        auto prev = std::prev(it);
+
+        if (prev->second.free) {
+            prev->second.size += it->second.size;
+            ranges.erase(it);
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#include "memory_policy.hpp"
+
+memory_policy memory_policy::gpuOnly() {
+    return memory_policy {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, 0};
+}
+
+memory_policy memory_policy::upload() {
+    // coherent, so sequential host writes need no flushes; write-combined rather than cached
+    return memory_policy {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+}
+
+memory_policy memory_policy::readbackCached() {
+    // uncached types are still taken when the device has no other, at the cost of slow reads
+    return memory_policy {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0};
+}
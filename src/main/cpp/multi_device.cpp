@@ -0,0 +1,87 @@
+#include "multi_device.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    bool hasComputeQueue(VkPhysicalDevice physicalDevice) {
+        std::uint32_t nQueueFamilies = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &nQueueFamilies, nullptr);
+
+        auto familyProperties = std::vector<VkQueueFamilyProperties> (nQueueFamilies);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &nQueueFamilies, familyProperties.data());
+
+        return std::any_of(familyProperties.begin(), familyProperties.end(), [](const VkQueueFamilyProperties& family) {
+            return 0 != (family.queueFlags & VK_QUEUE_COMPUTE_BIT);
+        });
+    }
+}
+
+multi_device::multi_device() {
+    instance = context::createInstance();
+
+    try {
+        for (auto physicalDevice : context::getPhysicalDevices(instance)) {
+            // a device that cannot run compute work takes no share rather than failing the whole run
+            if (hasComputeQueue(physicalDevice)) {
+                contexts.push_back(std::make_unique<context> (instance, physicalDevice));
+            }
+        }
+    } catch (...) {
+        contexts.clear();
+        vkDestroyInstance(instance, nullptr);
+        throw;
+    }
+
+    if (contexts.empty()) {
+        vkDestroyInstance(instance, nullptr);
+        throw std::runtime_error("No Vulkan devices with a compute queue found!");
+    }
+
+    throughput = std::vector<double> (contexts.size(), 0.0);
+}
+
+multi_device::~multi_device() {
+    contexts.clear();
+    vkDestroyInstance(instance, nullptr);
+}
+
+std::vector<multi_device::range> multi_device::partition(std::uint64_t count, std::uint64_t granularity) const {
+    auto measured = std::all_of(throughput.begin(), throughput.end(), [](double t) {
+        return t > 0.0;
+    });
+
+    auto weights = measured ? throughput : std::vector<double> (throughput.size(), 1.0);
+    double totalWeight = 0.0;
+
+    for (auto w : weights) {
+        totalWeight += w;
+    }
+
+    auto units = (count + granularity - 1) / granularity;
+    auto ranges = std::vector<range> ();
+    std::uint64_t offset = 0;
+
+    for (std::size_t i = 0; i < weights.size(); i++) {
+        // the last device takes whatever rounding left over
+        auto share = i + 1 == weights.size()
+                ? count - offset
+                : std::min(count - offset, static_cast<std::uint64_t> (units * weights[i] / totalWeight) * granularity);
+
+        ranges.push_back(range {offset, share});
+        offset += share;
+    }
+
+    return ranges;
+}
+
+void multi_device::recordThroughput(std::size_t device, std::uint64_t count, double milliseconds) {
+    if (0 == count || milliseconds <= 0.0) {
+        return;
+    }
+
+    auto sample = count / milliseconds;
+
+    // a running average smooths out clock ramp-up and one-off stalls
+    throughput[device] = throughput[device] > 0.0 ? 0.5 * (throughput[device] + sample) : sample;
+}
@@ -0,0 +1,109 @@
+#include "pipeline_cache.hpp"
+
+#include "util.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+pipeline_cache::pipeline_cache(context& ctx, const std::string& fileName) : ctx(ctx), fileName(fileName) {
+    auto data = std::vector<char>();
+
+    {
+        std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+
+        if (file.is_open()) {
+            data.resize(file.tellg());
+            file.seekg(0, std::ios::beg);
+            file.read(data.data(), data.size());
+
+            if (!file) {
+                data.clear();
+            }
+        }
+    }
+
+    warm = isCompatible(data);
+
+    VkPipelineCacheCreateInfo pipelineCacheCI {};
+    pipelineCacheCI.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    if (warm) {
+        pipelineCacheCI.initialDataSize = data.size();
+        pipelineCacheCI.pInitialData = data.data();
+    }
+
+    vkAssert(ctx.vk.vkCreatePipelineCache(ctx.device, &pipelineCacheCI, nullptr, &cache));
+}
+
+pipeline_cache::~pipeline_cache() {
+    try {
+        save();
+    } catch (const std::exception& ex) {
+        std::cerr << "Unable to save pipeline cache: " << ex.what() << std::endl;
+    }
+
+    ctx.vk.vkDestroyPipelineCache(ctx.device, cache, nullptr);
+}
+
+void pipeline_cache::save() const {
+    std::size_t size = 0;
+    vkAssert(ctx.vk.vkGetPipelineCacheData(ctx.device, cache, &size, nullptr));
+
+    auto data = std::vector<char>(size);
+    vkAssert(ctx.vk.vkGetPipelineCacheData(ctx.device, cache, &size, data.data()));
+
+    data.resize(size);
+
+    // write to a side file and rename so a crash mid-write never leaves a truncated cache behind
+    auto tmpFileName = fileName + ".tmp";
+
+    {
+        std::ofstream file(tmpFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file: " + tmpFileName);
+        }
+
+        file.write(data.data(), data.size());
+
+        if (!file) {
+            throw std::runtime_error("Unable to write file: " + tmpFileName);
+        }
+    }
+
+    if (0 != std::rename(tmpFileName.c_str(), fileName.c_str())) {
+        // rename does not replace an existing file on every platform
+        std::remove(fileName.c_str());
+
+        if (0 != std::rename(tmpFileName.c_str(), fileName.c_str())) {
+            throw std::runtime_error("Unable to replace file: " + fileName);
+        }
+    }
+}
+
+bool pipeline_cache::isWarm() const {
+    return warm;
+}
+
+bool pipeline_cache::isCompatible(const std::vector<char>& data) const {
+    VkPipelineCacheHeaderVersionOne header {};
+
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    const auto& properties = ctx.physicalDeviceProperties;
+
+    return header.headerSize >= sizeof(header)
+            && header.headerSize <= data.size()
+            && VK_PIPELINE_CACHE_HEADER_VERSION_ONE == header.headerVersion
+            && properties.vendorID == header.vendorID
+            && properties.deviceID == header.deviceID
+            && 0 == std::memcmp(properties.pipelineCacheUUID, header.pipelineCacheUUID, VK_UUID_SIZE);
+}
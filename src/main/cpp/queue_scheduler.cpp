@@ -0,0 +1,72 @@
+#include "queue_scheduler.hpp"
+
+queue_scheduler::queue_scheduler(context& ctx, std::uint32_t slotCount) : nextCompute(0), nextTransfer(0) {
+    for (auto familyId : ctx.computeQueueFamilyIds) {
+        for (std::uint32_t i = 0; i < ctx.queueFamilyProperties[familyId].queueCount; i++) {
+            computeQueues.push_back(std::make_unique<submission_queue> (ctx, familyId, i, slotCount));
+        }
+    }
+
+    // copies are recorded for a single family (see staging_ring), so only the first transfer-only one is used
+    if (!ctx.transferQueueFamilyIds.empty()) {
+        auto familyId = ctx.transferQueueFamilyIds[0];
+
+        for (std::uint32_t i = 0; i < ctx.queueFamilyProperties[familyId].queueCount; i++) {
+            transferQueues.push_back(std::make_unique<submission_queue> (ctx, familyId, i, slotCount));
+        }
+    }
+}
+
+bool queue_scheduler::hasDedicatedTransfer() const {
+    return !transferQueues.empty();
+}
+
+std::uint32_t queue_scheduler::getTransferQueueFamilyIndex() const {
+    if (transferQueues.empty()) {
+        return computeQueues.front()->getQueueFamilyIndex();
+    }
+
+    return transferQueues.front()->getQueueFamilyIndex();
+}
+
+std::size_t queue_scheduler::getComputeQueueCount() const {
+    return computeQueues.size();
+}
+
+submission_queue& queue_scheduler::computeQueue() {
+    auto& queue = *computeQueues[nextCompute];
+
+    nextCompute = (nextCompute + 1) % computeQueues.size();
+
+    return queue;
+}
+
+submission_queue& queue_scheduler::transferQueue() {
+    if (transferQueues.empty()) {
+        return computeQueue();
+    }
+
+    auto& queue = *transferQueues[nextTransfer];
+
+    nextTransfer = (nextTransfer + 1) % transferQueues.size();
+
+    return queue;
+}
+
+job_future queue_scheduler::submitCompute(const std::function<void(VkCommandBuffer)>& recorder) {
+    return computeQueue().submit(recorder);
+}
+
+job_future queue_scheduler::submitTransfer(const std::function<void(VkCommandBuffer)>& recorder) {
+    return transferQueue().submit(recorder);
+}
+
+void queue_scheduler::waitIdle() {
+    for (auto& queue : computeQueues) {
+        queue->waitIdle();
+    }
+
+    for (auto& queue : transferQueues) {
+        queue->waitIdle();
+    }
+}
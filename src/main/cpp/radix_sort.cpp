@@ -0,0 +1,244 @@
+#include "radix_sort.hpp"
+
+#include "util.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    // push constant uKeyType of radix_sort.comp
+    std::uint32_t getKeyTypeCode(element_type type) {
+        switch (type) {
+            case element_type::i32:
+                return 1;
+            case element_type::f32:
+                return 2;
+            default:
+                return 0;
+        }
+    }
+
+    void barrier(const context& ctx, VkCommandBuffer commandBuffer) {
+        VkMemoryBarrier barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+}
+
+radix_sorter::radix_sorter(context& ctx, VkPipelineCache pipelineCache)
+        : ctx(ctx), pipelineCache(pipelineCache), workgroupSize(ctx.getPreferredWorkgroupSize()), subgroup(ctx.subgroupBallot), queue(ctx, ctx.computeQueueFamilyIds[0]), scans(ctx, pipelineCache) {
+    counts = scratch_buffer {VK_NULL_HANDLE, memory_allocation(), 0};
+    scratchKeys = scratch_buffer {VK_NULL_HANDLE, memory_allocation(), 0};
+    scratchPayloads = scratch_buffer {VK_NULL_HANDLE, memory_allocation(), 0};
+    openRecordings = 0;
+}
+
+radix_sorter::~radix_sorter() {
+    queue.waitIdle();
+    histogramKernel.reset();
+    scatterKernel.reset();
+    payloadScatterKernel.reset();
+
+    destroy(counts);
+    destroy(scratchKeys);
+    destroy(scratchPayloads);
+}
+
+std::string radix_sorter::getSpvFileName(bool scatter, bool withPayloads, bool subgroup) {
+    if (!scatter) {
+        return "radix_histogram.comp.spv";
+    }
+
+    return std::string("radix_scatter") + (withPayloads ? "_payload" : "") + (subgroup ? "_subgroup" : "") + ".comp.spv";
+}
+
+std::vector<std::string> radix_sorter::getCompileCommands() {
+    auto commands = std::vector<std::string> {
+        "glslc -c src/main/glsl/radix_sort.comp -DPASS=PASS_HISTOGRAM -DPAYLOAD=0 -DSUBGROUP=0 -o " + getSpvFileName(false, false, false)
+    };
+
+    for (auto withPayloads : {false, true}) {
+        for (auto subgroup : {false, true}) {
+            commands.push_back(std::string("glslc -c src/main/glsl/radix_sort.comp")
+                    + (subgroup ? " --target-env=vulkan1.1" : "")
+                    + " -DPASS=PASS_SCATTER"
+                    + " -DPAYLOAD=" + (withPayloads ? "1" : "0")
+                    + " -DSUBGROUP=" + (subgroup ? "1" : "0")
+                    + " -o " + getSpvFileName(true, withPayloads, subgroup));
+        }
+    }
+
+    return commands;
+}
+
+void radix_sorter::sort(element_type keyType, VkBuffer keys, std::uint32_t count, VkBuffer payloads) {
+    if (count < 2) {
+        return;
+    }
+
+    prepare(count, VK_NULL_HANDLE != payloads);
+    beginRecording();
+
+    auto job = queue.submit([&](VkCommandBuffer commandBuffer) {
+        record(commandBuffer, keyType, keys, count, payloads);
+    });
+
+    endRecording(job);
+    job.wait();
+}
+
+void radix_sorter::prepare(std::uint32_t count, bool withPayloads) {
+    auto countCount = std::uint64_t(RADIX) * getTileCount(count);
+
+    if (countCount > UINT32_MAX) {
+        throw std::runtime_error("Too many keys to sort!");
+    }
+
+    reserve(counts, countCount * sizeof(std::uint32_t));
+    reserve(scratchKeys, VkDeviceSize(count) * sizeof(std::uint32_t));
+
+    if (withPayloads) {
+        reserve(scratchPayloads, VkDeviceSize(count) * sizeof(std::uint32_t));
+    }
+
+    scans.prepare(static_cast<std::uint32_t> (countCount));
+}
+
+void radix_sorter::beginRecording() {
+    for (auto pKernel : {histogramKernel.get(), scatterKernel.get(), payloadScatterKernel.get()}) {
+        if (pKernel) {
+            pKernel->beginRecording();
+        }
+    }
+
+    scans.beginRecording();
+    openRecordings++;
+}
+
+void radix_sorter::endRecording(const job_future& job) {
+    if (0 == openRecordings) {
+        throw std::runtime_error("Sort recording session was ended without being begun!");
+    }
+
+    for (auto pKernel : {histogramKernel.get(), scatterKernel.get(), payloadScatterKernel.get()}) {
+        if (pKernel) {
+            pKernel->endRecording(job);
+        }
+    }
+
+    scans.endRecording(job);
+    openRecordings--;
+}
+
+void radix_sorter::record(VkCommandBuffer commandBuffer, element_type keyType, VkBuffer keys, std::uint32_t count, VkBuffer payloads) {
+    if (count < 2) {
+        return;
+    }
+
+    auto withPayloads = VK_NULL_HANDLE != payloads;
+
+    if (scratchKeys.size < VkDeviceSize(count) * sizeof(std::uint32_t) || (withPayloads && scratchPayloads.size < VkDeviceSize(count) * sizeof(std::uint32_t))) {
+        throw std::runtime_error("radix_sorter::prepare() was not called for this sort!");
+    }
+
+    auto tileCount = getTileCount(count);
+    auto countCount = RADIX * tileCount;
+    auto groupCount = ctx.getGroupCount(std::uint64_t(tileCount) * workgroupSize, workgroupSize);
+
+    auto& histogram = getKernel(histogramKernel, getSpvFileName(false, false, false), 2);
+    auto& scatter = withPayloads
+            ? getKernel(payloadScatterKernel, getSpvFileName(true, true, subgroup), 5)
+            : getKernel(scatterKernel, getSpvFileName(true, false, subgroup), 3);
+
+    auto sourceKeys = keys;
+    auto sourcePayloads = payloads;
+    auto destinationKeys = scratchKeys.buffer;
+    auto destinationPayloads = scratchPayloads.buffer;
+
+    // an even number of passes, so the last one writes back to the caller's buffers
+    for (std::uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+        // the digit's bit position
+        auto parameters = std::vector<std::uint32_t> {count, pass * 8, getKeyTypeCode(keyType)};
+
+        histogram.record(commandBuffer, {sourceKeys, counts.buffer}, groupCount, parameters);
+        barrier(ctx, commandBuffer);
+        scans.record(commandBuffer, element_type::u32, counts.buffer, counts.buffer, countCount, true);
+        barrier(ctx, commandBuffer);
+
+        auto buffers = std::vector<VkBuffer> {sourceKeys, counts.buffer, destinationKeys};
+
+        if (withPayloads) {
+            buffers.push_back(sourcePayloads);
+            buffers.push_back(destinationPayloads);
+        }
+
+        scatter.record(commandBuffer, buffers, groupCount, parameters);
+        barrier(ctx, commandBuffer);
+
+        std::swap(sourceKeys, destinationKeys);
+        std::swap(sourcePayloads, destinationPayloads);
+    }
+}
+
+void radix_sorter::forget(VkBuffer buffer) {
+    for (auto pKernel : {histogramKernel.get(), scatterKernel.get(), payloadScatterKernel.get()}) {
+        if (pKernel) {
+            pKernel->forget(buffer);
+        }
+    }
+
+    scans.forget(buffer);
+}
+
+std::uint32_t radix_sorter::getTileCount(std::uint32_t count) const {
+    auto tileSize = ITEMS_PER_INVOCATION * workgroupSize;
+
+    return static_cast<std::uint32_t> ((std::uint64_t(count) + tileSize - 1) / tileSize);
+}
+
+compute_kernel& radix_sorter::getKernel(std::unique_ptr<compute_kernel>& kernel, const std::string& spvFileName, std::uint32_t bindingCount) {
+    if (!kernel) {
+        kernel = std::make_unique<compute_kernel> (ctx, "radix_sort", readFile(spvFileName), bindingCount, pipelineCache, std::vector<std::uint32_t> {workgroupSize}, 3);
+
+        // a kernel created inside recording sessions joins every open one
+        for (std::uint32_t i = 0; i < openRecordings; i++) {
+            kernel->beginRecording();
+        }
+    }
+
+    return *kernel;
+}
+
+void radix_sorter::reserve(scratch_buffer& scratch, VkDeviceSize size) {
+    if (scratch.size >= size) {
+        return;
+    }
+
+    destroy(scratch);
+
+    VkBufferCreateInfo bufferCI {};
+    bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferCI.size = size;
+
+    vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &scratch.buffer));
+    scratch.memory = ctx.bindMemory(scratch.buffer, memory_policy::gpuOnly());
+    scratch.size = size;
+}
+
+void radix_sorter::destroy(scratch_buffer& scratch) {
+    if (VK_NULL_HANDLE == scratch.buffer) {
+        return;
+    }
+
+    // every submission is waited for, so nothing still uses the buffer
+    forget(scratch.buffer);
+
+    ctx.vk.vkDestroyBuffer(ctx.device, scratch.buffer, nullptr);
+    ctx.freeMemory(scratch.memory);
+
+    scratch = scratch_buffer {VK_NULL_HANDLE, memory_allocation(), 0};
+}
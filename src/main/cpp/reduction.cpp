@@ -0,0 +1,181 @@
+#include "reduction.hpp"
+
+#include "util.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    // macro value reduce.comp compares TYPE against
+    const char * getTemplateTypeName(element_type type) {
+        switch (type) {
+            case element_type::f32:
+                return "TYPE_F32";
+            case element_type::i32:
+                return "TYPE_I32";
+            default:
+                return "TYPE_U32";
+        }
+    }
+
+    // macro value reduce.comp compares OPERATION against
+    const char * getTemplateOpName(reduce_op op) {
+        switch (op) {
+            case reduce_op::sum:
+                return "OP_SUM";
+            case reduce_op::min:
+                return "OP_MIN";
+            case reduce_op::max:
+                return "OP_MAX";
+            default:
+                return "OP_DOT";
+        }
+    }
+
+    void barrier(const context& ctx, VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkMemoryBarrier barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+
+        ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+}
+
+reducer::reducer(context& ctx, VkPipelineCache pipelineCache)
+        : ctx(ctx), pipelineCache(pipelineCache), workgroupSize(ctx.getPreferredWorkgroupSize()), subgroup(ctx.subgroupArithmetic), queue(ctx, ctx.computeQueueFamilyIds[0]) {
+    auto partialCount = VkDeviceSize(PARTIALS_PER_INVOCATION) * workgroupSize;
+
+    partialsBuffer = createBuffer(partialCount * sizeof(std::uint32_t), memory_policy::gpuOnly(), partialsMemory);
+    resultBuffer = createBuffer(sizeof(std::uint32_t), memory_policy::readbackCached(), resultMemory);
+}
+
+reducer::~reducer() {
+    queue.waitIdle();
+    kernels.clear();
+
+    ctx.vk.vkDestroyBuffer(ctx.device, resultBuffer, nullptr);
+    ctx.freeMemory(resultMemory);
+    ctx.vk.vkDestroyBuffer(ctx.device, partialsBuffer, nullptr);
+    ctx.freeMemory(partialsMemory);
+}
+
+const char * reducer::getOpName(reduce_op op) {
+    switch (op) {
+        case reduce_op::sum:
+            return "sum";
+        case reduce_op::min:
+            return "min";
+        case reduce_op::max:
+            return "max";
+        default:
+            return "dot";
+    }
+}
+
+std::string reducer::getSpvFileName(reduce_op op, element_type type, bool subgroup) {
+    return std::string("reduce_") + getOpName(op) + "_" + elementwise_library::getTypeName(type) + (subgroup ? "_subgroup" : "") + ".comp.spv";
+}
+
+std::string reducer::getCompileCommand(reduce_op op, element_type type, bool subgroup) {
+    return std::string("glslc -c src/main/glsl/reduce.comp")
+            + (subgroup ? " --target-env=vulkan1.1" : "")
+            + " -DTYPE=" + getTemplateTypeName(type)
+            + " -DOPERATION=" + getTemplateOpName(op)
+            + " -DSUBGROUP=" + (subgroup ? "1" : "0")
+            + " -o " + getSpvFileName(op, type, subgroup);
+}
+
+std::uint32_t reducer::reduce(reduce_op op, element_type type, VkBuffer input, std::uint32_t count, VkBuffer second) {
+    if (0 == count) {
+        throw std::runtime_error("Cannot reduce an empty buffer!");
+    }
+
+    if ((reduce_op::dot == op) != (VK_NULL_HANDLE != second)) {
+        throw std::runtime_error("Only dot products take a second input!");
+    }
+
+    // the first pass leaves at most PARTIALS_PER_INVOCATION partials per invocation of the second
+    auto& firstKernel = getKernel(op, type);
+    auto& secondKernel = getKernel(reduce_op::dot == op ? reduce_op::sum : op, type);
+
+    auto invocationCount = std::max(count / 4, count % 4);
+    auto maxGroupCount = PARTIALS_PER_INVOCATION * workgroupSize;
+    auto partialCount = std::min(ctx.getGroupCount(invocationCount, workgroupSize), maxGroupCount);
+
+    auto firstBuffers = std::vector<VkBuffer> {input, input};
+
+    if (reduce_op::dot == op) {
+        firstBuffers.push_back(second);
+        firstBuffers.push_back(second);
+    }
+
+    firstBuffers.push_back(partialsBuffer);
+
+    auto secondBuffers = std::vector<VkBuffer> {partialsBuffer, partialsBuffer, resultBuffer};
+
+    // both may be the same kernel, which sessions nest for
+    firstKernel.beginRecording();
+    secondKernel.beginRecording();
+
+    auto job = queue.submit([&](VkCommandBuffer commandBuffer) {
+        firstKernel.record(commandBuffer, firstBuffers, partialCount, {count});
+        barrier(ctx, commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        secondKernel.record(commandBuffer, secondBuffers, 1, {partialCount});
+        barrier(ctx, commandBuffer, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    });
+
+    firstKernel.endRecording(job);
+    secondKernel.endRecording(job);
+    job.wait();
+
+    std::uint32_t result;
+
+    ctx.invalidateMemory(resultMemory);
+    std::memcpy(&result, resultMemory.pMapped, sizeof(result));
+
+    return result;
+}
+
+float reducer::toFloat(std::uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+void reducer::forget(VkBuffer buffer) {
+    for (auto& entry : kernels) {
+        entry.second->forget(buffer);
+    }
+}
+
+compute_kernel& reducer::getKernel(reduce_op op, element_type type) {
+    auto key = std::make_tuple(op, type);
+    auto it = kernels.find(key);
+
+    if (it != kernels.end()) {
+        return *it->second;
+    }
+
+    // the input, and the second input of a dot product, as vectors and scalars, then the partials
+    auto bindingCount = reduce_op::dot == op ? 5 : 3;
+    auto pKernel = std::make_unique<compute_kernel> (ctx, std::string("reduce_") + getOpName(op), readFile(getSpvFileName(op, type, subgroup)), bindingCount, pipelineCache, std::vector<std::uint32_t> {workgroupSize}, 1);
+
+    return *(kernels[key] = std::move(pKernel));
+}
+
+VkBuffer reducer::createBuffer(VkDeviceSize size, const memory_policy& policy, memory_allocation& memory) {
+    VkBufferCreateInfo bufferCI {};
+    bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferCI.size = size;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &buffer));
+    memory = ctx.bindMemory(buffer, policy);
+
+    return buffer;
+}
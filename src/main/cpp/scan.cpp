@@ -0,0 +1,282 @@
+#include "scan.hpp"
+
+#include "util.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    // macro value scan.comp compares TYPE against
+    const char * getTemplateTypeName(element_type type) {
+        switch (type) {
+            case element_type::f32:
+                return "TYPE_F32";
+            case element_type::i32:
+                return "TYPE_I32";
+            default:
+                return "TYPE_U32";
+        }
+    }
+
+    void barrier(const context& ctx, VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkMemoryBarrier barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+
+        ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    std::uint32_t divideRoundingUp(std::uint32_t value, std::uint32_t divisor) {
+        return (value + divisor - 1) / divisor;
+    }
+}
+
+prefix_scan::prefix_scan(context& ctx, VkPipelineCache pipelineCache)
+        : ctx(ctx), pipelineCache(pipelineCache), workgroupSize(ctx.getPreferredWorkgroupSize()), subgroup(ctx.subgroupArithmetic), queue(ctx, ctx.computeQueueFamilyIds[0]) {
+    destinations = scratch_buffer {VK_NULL_HANDLE, memory_allocation(), 0};
+    kept = scratch_buffer {VK_NULL_HANDLE, memory_allocation(), 0};
+    openRecordings = 0;
+}
+
+prefix_scan::~prefix_scan() {
+    queue.waitIdle();
+    kernels.clear();
+    compactKernel.reset();
+
+    for (auto& level : levels) {
+        destroy(level);
+    }
+
+    destroy(destinations);
+    destroy(kept);
+}
+
+std::string prefix_scan::getSpvFileName(bool addPass, element_type type, bool subgroup) {
+    return std::string(addPass ? "scan_add_" : "scan_") + elementwise_library::getTypeName(type) + (subgroup ? "_subgroup" : "") + ".comp.spv";
+}
+
+std::vector<std::string> prefix_scan::getCompileCommands() {
+    auto commands = std::vector<std::string> ();
+
+    for (auto addPass : {false, true}) {
+        for (auto type : {element_type::f32, element_type::i32, element_type::u32}) {
+            for (auto subgroup : {false, true}) {
+                commands.push_back(std::string("glslc -c src/main/glsl/scan.comp")
+                        + (subgroup ? " --target-env=vulkan1.1" : "")
+                        + " -DTYPE=" + getTemplateTypeName(type)
+                        + " -DPASS=" + (addPass ? "PASS_ADD" : "PASS_SCAN")
+                        + " -DSUBGROUP=" + (subgroup ? "1" : "0")
+                        + " -o " + getSpvFileName(addPass, type, subgroup));
+            }
+        }
+    }
+
+    commands.push_back("glslc -c src/main/glsl/compact.comp -o compact.comp.spv");
+
+    return commands;
+}
+
+void prefix_scan::scan(element_type type, VkBuffer input, VkBuffer output, std::uint32_t count, bool exclusive) {
+    if (0 == count) {
+        return;
+    }
+
+    prepare(count);
+    beginRecording();
+
+    auto job = queue.submit([&](VkCommandBuffer commandBuffer) {
+        record(commandBuffer, type, input, output, count, exclusive);
+    });
+
+    endRecording(job);
+    job.wait();
+}
+
+void prefix_scan::prepare(std::uint32_t count) {
+    auto blockSize = ITEMS_PER_INVOCATION * workgroupSize;
+    std::size_t level = 0;
+
+    // the block totals of every level
+    for (;;) {
+        auto blockCount = divideRoundingUp(count, blockSize);
+
+        if (levels.size() <= level) {
+            levels.push_back(scratch_buffer {VK_NULL_HANDLE, memory_allocation(), 0});
+        }
+
+        reserve(levels[level], VkDeviceSize(blockCount) * sizeof(std::uint32_t), memory_policy::gpuOnly());
+
+        if (blockCount <= 1) {
+            return;
+        }
+
+        count = blockCount;
+        level++;
+    }
+}
+
+void prefix_scan::beginRecording() {
+    for (auto& entry : kernels) {
+        entry.second->beginRecording();
+    }
+
+    if (compactKernel) {
+        compactKernel->beginRecording();
+    }
+
+    openRecordings++;
+}
+
+void prefix_scan::endRecording(const job_future& job) {
+    if (0 == openRecordings) {
+        throw std::runtime_error("Scan recording session was ended without being begun!");
+    }
+
+    for (auto& entry : kernels) {
+        entry.second->endRecording(job);
+    }
+
+    if (compactKernel) {
+        compactKernel->endRecording(job);
+    }
+
+    openRecordings--;
+}
+
+void prefix_scan::record(VkCommandBuffer commandBuffer, element_type type, VkBuffer input, VkBuffer output, std::uint32_t count, bool exclusive) {
+    if (0 != count) {
+        recordScan(commandBuffer, type, input, output, count, exclusive, 0);
+    }
+}
+
+std::uint32_t prefix_scan::compact(VkBuffer values, VkBuffer flags, VkBuffer output, std::uint32_t count) {
+    if (0 == count) {
+        return 0;
+    }
+
+    prepare(count);
+    reserve(destinations, VkDeviceSize(count) * sizeof(std::uint32_t), memory_policy::gpuOnly());
+    reserve(kept, sizeof(std::uint32_t), memory_policy::readbackCached());
+
+    auto& kernel = getCompactKernel();
+    auto buffers = std::vector<VkBuffer> {values, flags, destinations.buffer, output, kept.buffer};
+
+    beginRecording();
+
+    auto job = queue.submit([&](VkCommandBuffer commandBuffer) {
+        record(commandBuffer, element_type::u32, flags, destinations.buffer, count, true);
+        barrier(ctx, commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        kernel.record(commandBuffer, buffers, ctx.getGroupCount(count, workgroupSize), {count});
+        barrier(ctx, commandBuffer, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    });
+
+    endRecording(job);
+    job.wait();
+
+    std::uint32_t keptCount;
+
+    ctx.invalidateMemory(kept.memory);
+    std::memcpy(&keptCount, kept.memory.pMapped, sizeof(keptCount));
+
+    return keptCount;
+}
+
+void prefix_scan::forget(VkBuffer buffer) {
+    for (auto& entry : kernels) {
+        entry.second->forget(buffer);
+    }
+
+    if (compactKernel) {
+        compactKernel->forget(buffer);
+    }
+}
+
+compute_kernel& prefix_scan::getKernel(bool addPass, element_type type) {
+    auto key = std::make_pair(addPass, type);
+    auto it = kernels.find(key);
+
+    if (it != kernels.end()) {
+        return *it->second;
+    }
+
+    // scan: inputs, outputs, block totals; count and exclusive. add: outputs, block offsets; count
+    auto bindingCount = addPass ? 2 : 3;
+    auto pushConstantCount = addPass ? 1 : 2;
+    auto pKernel = std::make_unique<compute_kernel> (ctx, addPass ? "scan_add" : "scan", readFile(getSpvFileName(addPass, type, subgroup)), bindingCount, pipelineCache, std::vector<std::uint32_t> {workgroupSize}, pushConstantCount);
+
+    return joinRecordings(*(kernels[key] = std::move(pKernel)));
+}
+
+compute_kernel& prefix_scan::getCompactKernel() {
+    if (!compactKernel) {
+        compactKernel = std::make_unique<compute_kernel> (ctx, "compact", readFile("compact.comp.spv"), 5, pipelineCache, std::vector<std::uint32_t> {workgroupSize}, 1);
+        joinRecordings(*compactKernel);
+    }
+
+    return *compactKernel;
+}
+
+compute_kernel& prefix_scan::joinRecordings(compute_kernel& kernel) {
+    for (std::uint32_t i = 0; i < openRecordings; i++) {
+        kernel.beginRecording();
+    }
+
+    return kernel;
+}
+
+void prefix_scan::reserve(scratch_buffer& scratch, VkDeviceSize size, const memory_policy& policy) {
+    if (scratch.size >= size) {
+        return;
+    }
+
+    destroy(scratch);
+
+    VkBufferCreateInfo bufferCI {};
+    bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCI.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferCI.size = size;
+
+    vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &scratch.buffer));
+    scratch.memory = ctx.bindMemory(scratch.buffer, policy);
+    scratch.size = size;
+}
+
+void prefix_scan::destroy(scratch_buffer& scratch) {
+    if (VK_NULL_HANDLE == scratch.buffer) {
+        return;
+    }
+
+    // every submission is waited for, so nothing still uses the buffer
+    forget(scratch.buffer);
+
+    ctx.vk.vkDestroyBuffer(ctx.device, scratch.buffer, nullptr);
+    ctx.freeMemory(scratch.memory);
+
+    scratch = scratch_buffer {VK_NULL_HANDLE, memory_allocation(), 0};
+}
+
+void prefix_scan::recordScan(VkCommandBuffer commandBuffer, element_type type, VkBuffer input, VkBuffer output, std::uint32_t count, bool exclusive, std::size_t level) {
+    auto blockSize = ITEMS_PER_INVOCATION * workgroupSize;
+    auto blockCount = divideRoundingUp(count, blockSize);
+    auto totals = levels[level].buffer;
+
+    auto& scanKernel = getKernel(false, type);
+
+    scanKernel.record(commandBuffer, {input, output, totals}, ctx.getGroupCount(std::uint64_t(blockCount) * workgroupSize, workgroupSize), {count, exclusive ? 1u : 0u});
+
+    if (1 == blockCount) {
+        return;
+    }
+
+    // the block totals become the offsets of their blocks, scanned in place
+    barrier(ctx, commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    recordScan(commandBuffer, type, totals, totals, blockCount, true, level + 1);
+    barrier(ctx, commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    auto& addKernel = getKernel(true, type);
+
+    addKernel.record(commandBuffer, {output, totals}, ctx.getGroupCount(count - blockSize, workgroupSize), {count});
+}
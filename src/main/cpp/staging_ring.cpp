@@ -0,0 +1,213 @@
+#include "staging_ring.hpp"
+
+#include "gpu_profiler.hpp"
+#include "util.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+staging_ring::staging_ring(context& ctx, VkDeviceSize capacity, std::uint32_t queueFamilyIndex) : ctx(ctx) {
+    const auto& limits = ctx.physicalDeviceProperties.limits;
+
+    if (VK_QUEUE_FAMILY_IGNORED == queueFamilyIndex) {
+        queueFamilyIndex = ctx.computeQueueFamilyIds[0];
+    }
+
+    const auto& family = ctx.queueFamilyProperties[queueFamilyIndex];
+
+    this->computeBarriers = 0 != (family.queueFlags & VK_QUEUE_COMPUTE_BIT);
+    // vkCmdResetQueryPool is not available on transfer-only queues, so their copies go unprofiled
+    this->timestamps = this->computeBarriers && 0 != family.timestampValidBits;
+
+    this->capacity = capacity;
+    this->alignment = std::max<VkDeviceSize> ({16, limits.optimalBufferCopyOffsetAlignment, limits.nonCoherentAtomSize});
+    this->head = 0;
+
+    VkBufferCreateInfo bufferCI {};
+    bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCI.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferCI.size = capacity;
+
+    ctx.shareAcrossQueueFamilies(bufferCI);
+
+    vkAssert(ctx.vk.vkCreateBuffer(ctx.device, &bufferCI, nullptr, &buffer));
+
+    VkMemoryRequirements memReqs;
+    ctx.vk.vkGetBufferMemoryRequirements(ctx.device, buffer, &memReqs);
+
+    // the ring stays mapped for its whole lifetime, so it gets its own VkDeviceMemory rather than
+    // a range of an arena block that someone else may want to map
+    VkMemoryAllocateInfo allocInfo {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memReqs.size;
+    allocInfo.memoryTypeIndex = ctx.getMemoryTypeIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    vkAssert(ctx.vk.vkAllocateMemory(ctx.device, &allocInfo, nullptr, &memory));
+    vkAssert(ctx.vk.vkBindBufferMemory(ctx.device, buffer, memory, 0));
+    vkAssert(ctx.vk.vkMapMemory(ctx.device, memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **> (&pMapped)));
+}
+
+staging_ring::~staging_ring() {
+    while (!regions.empty() && regions.front().closed) {
+        reclaim(true);
+    }
+
+    ctx.vk.vkUnmapMemory(ctx.device, memory);
+    ctx.vk.vkDestroyBuffer(ctx.device, buffer, nullptr);
+    ctx.vk.vkFreeMemory(ctx.device, memory, nullptr);
+}
+
+void staging_ring::upload(VkCommandBuffer commandBuffer, VkBuffer dst, VkDeviceSize dstOffset, const void * data, VkDeviceSize size) {
+    auto offset = allocate(size);
+
+    std::memcpy(pMapped + offset, data, size);
+
+    VkBufferCopy region {};
+    region.srcOffset = offset;
+    region.dstOffset = dstOffset;
+    region.size = size;
+
+    auto profiler = timestamps ? ctx.profiler : nullptr;
+    auto scope = nullptr != profiler ? profiler->begin(commandBuffer, "upload") : 0;
+
+    ctx.vk.vkCmdCopyBuffer(commandBuffer, buffer, dst, 1, &region);
+
+    if (nullptr != profiler) {
+        profiler->end(commandBuffer, scope);
+    }
+
+    if (!computeBarriers) {
+        return;
+    }
+
+    VkBufferMemoryBarrier barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = dst;
+    barrier.offset = dstOffset;
+    barrier.size = size;
+
+    ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+const void * staging_ring::readback(VkCommandBuffer commandBuffer, VkBuffer src, VkDeviceSize srcOffset, VkDeviceSize size) {
+    auto offset = allocate(size);
+
+    VkBufferMemoryBarrier barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = src;
+    barrier.offset = srcOffset;
+    barrier.size = size;
+
+    if (computeBarriers) {
+        ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    VkBufferCopy region {};
+    region.srcOffset = srcOffset;
+    region.dstOffset = offset;
+    region.size = size;
+
+    auto profiler = timestamps ? ctx.profiler : nullptr;
+    auto scope = nullptr != profiler ? profiler->begin(commandBuffer, "readback") : 0;
+
+    ctx.vk.vkCmdCopyBuffer(commandBuffer, src, buffer, 1, &region);
+
+    if (nullptr != profiler) {
+        profiler->end(commandBuffer, scope);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+
+    ctx.vk.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    return pMapped + offset;
+}
+
+void staging_ring::endBatch(const job_future& completion) {
+    for (auto& r : regions) {
+        if (!r.closed) {
+            r.closed = true;
+            r.completion = completion;
+        }
+    }
+
+    reclaim(false);
+}
+
+VkDeviceSize staging_ring::allocate(VkDeviceSize size) {
+    auto alignedSize = (size + alignment - 1) / alignment * alignment;
+
+    if (alignedSize > capacity) {
+        throw std::runtime_error("Transfer is larger than the staging ring!");
+    }
+
+    reclaim(false);
+
+    while (true) {
+        VkDeviceSize offset = std::numeric_limits<VkDeviceSize>::max();
+
+        if (regions.empty()) {
+            offset = 0;
+        } else {
+            auto tail = regions.front().offset;
+
+            if (head > tail) {
+                // free space is [head, capacity) followed by [0, tail)
+                if (head + alignedSize <= capacity) {
+                    offset = head;
+                } else if (alignedSize <= tail) {
+                    offset = 0;
+                }
+            } else if (head + alignedSize <= tail) {
+                offset = head;
+            }
+        }
+
+        if (std::numeric_limits<VkDeviceSize>::max() != offset) {
+            regions.push_back(region {offset, alignedSize, false, job_future()});
+            head = offset + alignedSize;
+
+            return offset;
+        }
+
+        if (!regions.front().closed) {
+            throw std::runtime_error("Staging ring is full; submit the pending batch before recording more transfers!");
+        }
+
+        reclaim(true);
+    }
+}
+
+void staging_ring::reclaim(bool wait) {
+    while (!regions.empty() && regions.front().closed) {
+        const auto& completion = regions.front().completion;
+
+        if (wait) {
+            completion.wait();
+            // only block for the oldest batch; the rest are polled
+            wait = false;
+        } else if (!completion.isReady()) {
+            return;
+        }
+
+        regions.pop_front();
+    }
+
+    if (regions.empty()) {
+        head = 0;
+    }
+}
@@ -0,0 +1,170 @@
+#include "submission_queue.hpp"
+
+#include "gpu_profiler.hpp"
+#include "util.hpp"
+
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+job_future::job_future() : queue(nullptr), ticket(0) {}
+
+job_future::job_future(submission_queue * queue, std::uint64_t ticket) : queue(queue), ticket(ticket) {}
+
+bool job_future::isReady() const {
+    return nullptr == queue || queue->poll(ticket);
+}
+
+void job_future::wait() const {
+    if (nullptr != queue) {
+        queue->wait(ticket);
+    }
+}
+
+submission_queue::submission_queue(context& ctx, std::uint32_t queueFamilyIndex, std::uint32_t queueIndex, std::uint32_t slotCount) : ctx(ctx), queueFamilyIndex(queueFamilyIndex) {
+    if (0 == slotCount) {
+        throw std::runtime_error("A submission queue needs at least one slot!");
+    }
+
+    ctx.vk.vkGetDeviceQueue(ctx.device, queueFamilyIndex, queueIndex, &queue);
+
+    // tickets start at 1 so that 0 always reads as complete
+    nextTicket = 1;
+    completedTicket = 0;
+
+    slots.resize(slotCount);
+
+    for (auto& s : slots) {
+        VkCommandPoolCreateInfo commandPoolCI {};
+        commandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolCI.queueFamilyIndex = queueFamilyIndex;
+        commandPoolCI.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        vkAssert(ctx.vk.vkCreateCommandPool(ctx.device, &commandPoolCI, nullptr, &s.commandPool));
+
+        VkCommandBufferAllocateInfo commandBufferAI {};
+        commandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAI.commandPool = s.commandPool;
+        commandBufferAI.commandBufferCount = 1;
+
+        vkAssert(ctx.vk.vkAllocateCommandBuffers(ctx.device, &commandBufferAI, &s.commandBuffer));
+
+        VkFenceCreateInfo fenceCI {};
+        fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        vkAssert(ctx.vk.vkCreateFence(ctx.device, &fenceCI, nullptr, &s.fence));
+
+        s.ticket = 0;
+    }
+}
+
+submission_queue::~submission_queue() {
+    waitIdle();
+
+    for (auto& s : slots) {
+        ctx.vk.vkDestroyFence(ctx.device, s.fence, nullptr);
+        ctx.vk.vkDestroyCommandPool(ctx.device, s.commandPool, nullptr);
+    }
+}
+
+job_future submission_queue::submit(const std::function<void(VkCommandBuffer)>& recorder) {
+    auto& s = acquireSlot();
+
+    // resetting the whole pool is cheaper than resetting its single command buffer
+    vkAssert(ctx.vk.vkResetCommandPool(ctx.device, s.commandPool, 0));
+
+    VkCommandBufferBeginInfo commandBufferBI {};
+    commandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkAssert(ctx.vk.vkBeginCommandBuffer(s.commandBuffer, &commandBufferBI));
+
+    recorder(s.commandBuffer);
+
+    vkAssert(ctx.vk.vkEndCommandBuffer(s.commandBuffer));
+
+    return submit(s, s.commandBuffer);
+}
+
+job_future submission_queue::submit(VkCommandBuffer commandBuffer) {
+    return submit(acquireSlot(), commandBuffer);
+}
+
+void submission_queue::waitIdle() {
+    wait(nextTicket - 1);
+}
+
+std::uint32_t submission_queue::getQueueFamilyIndex() const {
+    return queueFamilyIndex;
+}
+
+submission_queue::slot& submission_queue::acquireSlot() {
+    auto& s = slots[nextTicket % slots.size()];
+
+    // the slot's previous job must retire before its fence and command buffer are reused
+    wait(s.ticket);
+
+    return s;
+}
+
+job_future submission_queue::submit(slot& s, VkCommandBuffer commandBuffer) {
+    vkAssert(ctx.vk.vkResetFences(ctx.device, 1, &s.fence));
+
+    VkSubmitInfo submitInfo {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    // the host latency the profiler reports includes the submit itself
+    auto submitTime = std::chrono::steady_clock::now();
+
+    vkAssert(ctx.vk.vkQueueSubmit(queue, 1, &submitInfo, s.fence));
+
+    s.ticket = nextTicket++;
+
+    auto future = job_future(this, s.ticket);
+
+    if (nullptr != ctx.profiler) {
+        ctx.profiler->endBatch(future, submitTime);
+    }
+
+    return future;
+}
+
+bool submission_queue::poll(std::uint64_t ticket) {
+    if (ticket <= completedTicket) {
+        return true;
+    }
+
+    const auto& s = slots[ticket % slots.size()];
+
+    // a newer ticket in the slot means this job finished before the slot was reused
+    if (s.ticket != ticket || VK_SUCCESS == ctx.vk.vkGetFenceStatus(ctx.device, s.fence)) {
+        complete(ticket);
+        return true;
+    }
+
+    return false;
+}
+
+void submission_queue::wait(std::uint64_t ticket) {
+    if (poll(ticket)) {
+        return;
+    }
+
+    const auto& s = slots[ticket % slots.size()];
+
+    vkAssert(ctx.vk.vkWaitForFences(ctx.device, 1, &s.fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+
+    complete(ticket);
+}
+
+void submission_queue::complete(std::uint64_t ticket) {
+    completedTicket = ticket;
+
+    // stamping the completion now, not whenever the profiler collects, keeps the host latency honest
+    if (nullptr != ctx.profiler) {
+        ctx.profiler->observeCompletions();
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef COMPUTE_KERNEL_HPP_
+#define COMPUTE_KERNEL_HPP_
+
+#include "volk.h"
+
+#include "context.hpp"
+#include "descriptor_cache.hpp"
+#include "submission_queue.hpp"
+
+#include <cstdint>
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// A compute pipeline whose shader binds bindingCount storage buffers at set 0, bindings [0, bindingCount).
+// specializationConstants[i] is supplied as the 32-bit specialization constant with constant_id = i.
+// The shader may also declare a push constant block of pushConstantCount 32-bit words; every
+// dispatch then passes exactly that many words, pushConstants[i] landing at byte offset 4 * i.
+// A kernel with no bindings reads and writes through buffer device addresses passed that way.
+//
+// All Vulkan objects are created once in the constructor. dispatch() records a command buffer and
+// descriptor set the first time it sees a (buffers, groupCount) combination and replays them afterwards,
+// so a repeated dispatch costs one vkQueueSubmit and one fence wait, or just the submit with submit().
+// Where VK_KHR_push_descriptor is enabled the bindings are pushed straight into the command buffer,
+// so a dispatch touches no descriptor pool at all. Otherwise descriptor sets come from a
+// descriptor_cache, so dispatches over buffers the kernel has seen before never call
+// vkUpdateDescriptorSets. Call forget() before destroying a buffer the kernel was given.
+// Dispatches recorded into caller-owned command buffers bind sets from the same cache, so they go
+// inside a recording session that names the job executing them; the caches are only ever flushed
+// outside every session, once the jobs of the closed ones have finished.
+// While context::profiler is set, dispatches are re-recorded each time so every one gets fresh
+// timestamp queries labelled with the kernel's name.
+struct compute_kernel {
+    // descriptor sets (forgotten ones included) and command buffers remembered before the caches
+    // are flushed
+    static constexpr std::uint32_t MAX_CACHED_BINDINGS = 1024;
+
+    std::string name;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+
+    compute_kernel(context& ctx, const std::string& name, const std::vector<char>& spvCode, std::uint32_t bindingCount, VkPipelineCache pipelineCache = VK_NULL_HANDLE, const std::vector<std::uint32_t>& specializationConstants = {}, std::uint32_t pushConstantCount = 0);
+
+    ~compute_kernel();
+
+    compute_kernel(const compute_kernel&) = delete;
+
+    compute_kernel& operator=(const compute_kernel&) = delete;
+
+    // false when bindings are pushed or there are none, in which case descriptorSetLayout must
+    // not be used to allocate descriptor sets
+    bool needsDescriptorSet() const;
+
+    // opens a recording session, first flushing the caches if they are full and no other session
+    // is open; sessions nest
+    void beginRecording();
+
+    // closes the session; job executes every command buffer recorded in it, or is a default
+    // job_future if the caller has already waited for them. Its queue must outlive the kernel.
+    void endRecording(const job_future& job);
+
+    // records the bind + dispatch into a caller-owned command buffer, inside a recording session.
+    // Never flushes the caches, so the sets bound earlier in the session stay valid.
+    void record(VkCommandBuffer commandBuffer, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants = {});
+
+    // records the dispatch with a descriptor set the caller allocated from descriptorSetLayout and
+    // owns; touches no kernel state, so any number of threads may call it at once (unprofiled).
+    // descriptorSet is ignored, and may be VK_NULL_HANDLE, unless needsDescriptorSet().
+    void record(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants = {}) const;
+
+    // submits the dispatch on the first compute queue and waits for it to finish
+    void dispatch(const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants = {});
+
+    // submits the pre-recorded dispatch without waiting; the queue must outlive the kernel. Queues
+    // outside the first compute family get a freshly recorded command buffer instead.
+    job_future submit(submission_queue& queue, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants = {});
+
+    // drops the cached descriptor sets and command buffers that reference buffer, waiting for
+    // submitted jobs if one of them may still be executing; a new buffer may reuse the handle
+    void forget(VkBuffer buffer);
+
+    // descriptor pools the kernel's cache has created; stays bounded however many buffers are
+    // forgotten, and is 0 with push descriptors
+    std::size_t getDescriptorPoolCount() const;
+
+private:
+    // (buffers, groupCount, pushConstants) of a cached command buffer
+    using dispatch_key = std::tuple<std::vector<VkBuffer>, std::uint32_t, std::vector<std::uint32_t>>;
+
+    context& ctx;
+    std::uint32_t bindingCount;
+    std::uint32_t pushConstantCount;
+    bool pushDescriptors;
+    VkQueue queue;
+    descriptor_cache descriptors;
+    VkCommandPool commandPool;
+    VkFence fence;
+    std::map<dispatch_key, VkCommandBuffer> commandBuffers;
+    std::vector<job_future> pendingJobs;
+    std::uint32_t openRecordings;
+
+    // makes flushing the caches wait for job
+    void track(const job_future& job);
+
+    void waitPendingJobs();
+
+    // whether either cache has reached MAX_CACHED_BINDINGS
+    bool isCacheFull() const;
+
+    // frees every cached command buffer and descriptor set once the jobs using them are done
+    void flushCaches();
+
+    VkDescriptorSet getDescriptorSet(const std::vector<VkBuffer>& buffers);
+
+    // record() without the session check, for the command buffers the kernel records itself
+    void recordCached(VkCommandBuffer commandBuffer, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants);
+
+    void writeDescriptorSet(VkDescriptorSet descriptorSet, const std::vector<VkBuffer>& buffers) const;
+
+    static std::vector<descriptor_binding> toBindings(const std::vector<VkBuffer>& buffers);
+
+    // binds descriptorSet, or pushes buffers when the kernel uses push descriptors
+    void recordDispatch(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants) const;
+
+    VkCommandBuffer getCommandBuffer(const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants);
+
+    VkCommandBuffer recordCommandBuffer(const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants, VkCommandBufferUsageFlags usage);
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef CONTEXT_HPP_
+#define CONTEXT_HPP_
+
+#include "volk.h"
+
+#include "memory_arena.hpp"
+#include "memory_policy.hpp"
+
+#include <cstdint>
+
+#include <memory>
+#include <vector>
+
+struct gpu_profiler;
+
+struct context {
+    // invocations per workgroup aimed for before clamping to the device limits
+    static constexpr std::uint32_t PREFERRED_WORKGROUP_INVOCATIONS = 256;
+
+    // host-visible device-local memory is a 256MB BAR window on most discrete GPUs, so its
+    // DEVICE_LOCAL flag only counts as preferred for requests up to this fraction of its heap
+    static constexpr VkDeviceSize HOST_VISIBLE_DEVICE_LOCAL_DIVISOR = 4;
+
+    VkInstance instance;
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    // every device-level call goes through this table rather than volk's global function pointers
+    VolkDeviceTable vk;
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    std::vector<VkQueueFamilyProperties> queueFamilyProperties;
+    // families with compute support, in enumeration order; every queue in them is created
+    std::vector<std::uint32_t> computeQueueFamilyIds;
+    // transfer-only families (dedicated DMA engines); every queue in them is created
+    std::vector<std::uint32_t> transferQueueFamilyIds;
+    // computeQueueFamilyIds followed by transferQueueFamilyIds
+    std::vector<std::uint32_t> queueFamilyIds;
+    std::uint32_t subgroupSize;
+    // compute shaders may use GL_KHR_shader_subgroup_arithmetic; assumes an instance from createInstance()
+    bool subgroupArithmetic;
+    // compute shaders may use GL_KHR_shader_subgroup_ballot; assumes an instance from createInstance()
+    bool subgroupBallot;
+    // descriptors a pushed set may hold; 0 when VK_KHR_push_descriptor is not enabled
+    std::uint32_t maxPushDescriptors;
+    // VK_KHR_buffer_device_address is enabled; every arena allocation can then back an addressed buffer
+    bool bufferDeviceAddress;
+    // pointer and size granularity of VK_EXT_external_memory_host imports; 0 when it is not enabled
+    VkDeviceSize minImportedHostPointerAlignment;
+    // VK_EXT_memory_budget is enabled, so getHeapHeadroom() reports live budgets rather than heap sizes
+    bool memoryBudget;
+    std::unique_ptr<memory_arena> arena;
+    // when set, kernels, staging copies and submissions record GPU timestamps into it
+    gpu_profiler * profiler = nullptr;
+
+    // the last discrete GPU (or the first device) on an instance of its own
+    context();
+
+    // a device of an instance owned by the caller, which must outlive the context
+    context(VkInstance instance, VkPhysicalDevice physicalDevice);
+
+    ~context();
+
+    context(const context&) = delete;
+
+    context& operator=(const context&) = delete;
+
+    // creates an instance with the layers and extensions every context expects and loads volk for it
+    static VkInstance createInstance();
+
+    static std::vector<VkPhysicalDevice> getPhysicalDevices(VkInstance instance);
+
+    // a type with every flag of requirementsMask
+    std::uint32_t getMemoryTypeIndex(std::uint32_t typeBits, unsigned int requirementsMask) const;
+
+    // the best type for the policy among typeBits; size weighs in the heaps' remaining budgets,
+    // against the memory the arena would actually have to allocate for it
+    std::uint32_t getMemoryTypeIndex(std::uint32_t typeBits, const memory_policy& policy, VkDeviceSize size = 0) const;
+
+    // bytes each heap can still take: its budget minus its usage with VK_EXT_memory_budget,
+    // otherwise its size minus the arena's blocks in it
+    std::vector<VkDeviceSize> getHeapHeadroom() const;
+
+    // true for integrated/CPU devices, where host-visible memory is as fast as device-local memory
+    bool isUnifiedMemory() const;
+
+    memory_allocation bindMemory(VkBuffer buffer, VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    memory_allocation bindMemory(VkBuffer buffer, const memory_policy& policy);
+
+    void freeMemory(const memory_allocation& allocation);
+
+    // host writes through allocation.pMapped must be flushed before the device reads them,
+    // and device writes invalidated before the host reads them; both are free on coherent memory
+    void flushMemory(const memory_allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
+
+    void invalidateMemory(const memory_allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
+
+    // makes a buffer usable from every created queue family without ownership transfers
+    void shareAcrossQueueFamilies(VkBufferCreateInfo& bufferCI) const;
+
+    // adds SHADER_DEVICE_ADDRESS usage when bufferDeviceAddress is set
+    void enableDeviceAddress(VkBufferCreateInfo& bufferCI) const;
+
+    // the buffer's address for shaders using GL_EXT_buffer_reference; needs bufferDeviceAddress and
+    // a buffer created after enableDeviceAddress()
+    std::uint64_t getDeviceAddress(VkBuffer buffer) const;
+
+    // a multiple of subgroupSize within maxComputeWorkGroupSize[0] and maxComputeWorkGroupInvocations,
+    // meant for a kernel's local_size_x_id specialization constant
+    std::uint32_t getPreferredWorkgroupSize() const;
+
+    // workgroups covering invocations, rounded up and capped at maxComputeWorkGroupCount[0];
+    // kernels must bounds-check and stride over anything beyond the grid
+    std::uint32_t getGroupCount(std::uint64_t invocations, std::uint32_t workgroupSize) const;
+
+private:
+    bool ownsInstance;
+    PFN_vkVoidFunction getBufferDeviceAddress;
+
+    void init(VkPhysicalDevice physicalDevice);
+};
+
+#endif
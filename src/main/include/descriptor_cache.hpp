@@ -0,0 +1,123 @@
+#ifndef DESCRIPTOR_CACHE_HPP_
+#define DESCRIPTOR_CACHE_HPP_
+
+#include "volk.h"
+
+#include "context.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <unordered_map>
+#include <vector>
+
+// One storage buffer binding; binding i of a set gets the i-th entry of a binding list.
+struct descriptor_binding {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize range;
+
+    bool operator==(const descriptor_binding& other) const;
+};
+
+// writes bindings[i] into binding i of descriptorSet as a storage buffer
+void writeDescriptorSet(const context& ctx, VkDescriptorSet descriptorSet, const std::vector<descriptor_binding>& bindings);
+
+// records bindings as set 0 of pipelineLayout with vkCmdPushDescriptorSetKHR; needs
+// context::maxPushDescriptors >= bindings.size() and a set layout created with the push descriptor flag
+void pushDescriptorSet(const context& ctx, VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const std::vector<descriptor_binding>& bindings);
+
+// Hands out storage buffer descriptor sets from a chain of pools. When the current pool cannot
+// hold another set, the next one is used, created on demand, so allocation never fails for lack
+// of pool space. Sets are only returned all at once by reset().
+struct descriptor_allocator {
+    static constexpr std::uint32_t SETS_PER_POOL = 256;
+    static constexpr std::uint32_t STORAGE_BUFFERS_PER_POOL = 1024;
+
+    descriptor_allocator(context& ctx);
+
+    ~descriptor_allocator();
+
+    descriptor_allocator(const descriptor_allocator&) = delete;
+
+    descriptor_allocator& operator=(const descriptor_allocator&) = delete;
+
+    // storageBufferCount is the number of storage buffer descriptors in layout
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout, std::uint32_t storageBufferCount);
+
+    // returns every set to its pool; none of them may still be in use by the device
+    void reset();
+
+    std::size_t getPoolCount() const;
+
+private:
+    struct pool {
+        VkDescriptorPool descriptorPool;
+        std::uint32_t setsLeft;
+        std::uint32_t storageBufferCapacity;
+        std::uint32_t storageBuffersLeft;
+    };
+
+    context& ctx;
+    std::vector<pool> pools;
+    std::size_t current;
+
+    pool createPool(std::uint32_t storageBufferCount);
+};
+
+// Remembers written descriptor sets by (layout, bindings), so a repeated dispatch over the same
+// buffer ranges reuses its set and skips vkUpdateDescriptorSets. Not thread-safe.
+//
+// The cache keys on buffer handles, and a destroyed buffer's handle may be handed out again, so
+// invalidate() a buffer before destroying it.
+struct descriptor_cache {
+    descriptor_cache(context& ctx);
+
+    descriptor_cache(const descriptor_cache&) = delete;
+
+    descriptor_cache& operator=(const descriptor_cache&) = delete;
+
+    VkDescriptorSet get(VkDescriptorSetLayout layout, const std::vector<descriptor_binding>& bindings);
+
+    // whether get() would hit, i.e. allocate nothing
+    bool contains(VkDescriptorSetLayout layout, const std::vector<descriptor_binding>& bindings) const;
+
+    // forgets every set that references buffer; the sets stay allocated until clear(), and keep
+    // counting toward getAllocatedCount()
+    void invalidate(VkBuffer buffer);
+
+    // forgets every set and resets the pools; none of the sets may still be in use by the device
+    void clear();
+
+    std::size_t size() const;
+
+    // sets allocated since the last clear(), including the ones invalidate() forgot
+    std::size_t getAllocatedCount() const;
+
+    std::size_t getPoolCount() const;
+
+    std::uint64_t getHitCount() const;
+
+    std::uint64_t getMissCount() const;
+
+private:
+    struct key {
+        VkDescriptorSetLayout layout;
+        std::vector<descriptor_binding> bindings;
+
+        bool operator==(const key& other) const;
+    };
+
+    struct key_hash {
+        std::size_t operator()(const key& k) const;
+    };
+
+    context& ctx;
+    descriptor_allocator allocator;
+    std::unordered_map<key, VkDescriptorSet, key_hash> sets;
+    std::size_t allocatedCount;
+    std::uint64_t hitCount;
+    std::uint64_t missCount;
+};
+
+#endif
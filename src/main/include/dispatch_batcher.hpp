@@ -0,0 +1,98 @@
+#ifndef DISPATCH_BATCHER_HPP_
+#define DISPATCH_BATCHER_HPP_
+
+#include "volk.h"
+
+#include "compute_kernel.hpp"
+#include "context.hpp"
+#include "submission_queue.hpp"
+
+#include <chrono>
+#include <cstdint>
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+struct dispatch_batcher;
+
+// Completion handle for one dispatch queued on a dispatch_batcher. A default-constructed job is already complete.
+struct batched_job {
+    batched_job();
+
+    // submits the job's batch if its latency budget has run out, so polling this alone makes progress
+    bool isReady() const;
+
+    // submits the job's batch first if it is still open
+    void wait() const;
+
+private:
+    friend struct dispatch_batcher;
+
+    dispatch_batcher * batcher;
+    std::uint64_t batchId;
+
+    batched_job(dispatch_batcher * batcher, std::uint64_t batchId);
+};
+
+// Coalesces small dispatches into one command buffer and one vkQueueSubmit.
+//
+// Work is queued as recorders and replayed into a single submission_queue job when the batch holds
+// maxDispatches entries, when the oldest entry has waited maxLatency (checked on every queue, by
+// poll() and by batched_job::isReady()), or when a job of the batch is waited on. Entries in a batch
+// may run concurrently; call barrier() between two that depend on each other. Each batch is one
+// recording session of every kernel it dispatches, so their caches outlive the batch. Commands
+// queued with record() must not use compute_kernel::record().
+struct dispatch_batcher {
+    static constexpr std::uint32_t DEFAULT_MAX_DISPATCHES = 256;
+    static constexpr std::int64_t DEFAULT_MAX_LATENCY_US = 200;
+
+    // the queue must outlive the batcher and every kernel it dispatches
+    dispatch_batcher(context& ctx, submission_queue& queue, std::uint32_t maxDispatches = DEFAULT_MAX_DISPATCHES,
+            std::chrono::microseconds maxLatency = std::chrono::microseconds(DEFAULT_MAX_LATENCY_US));
+
+    // submits the open batch and waits for everything
+    ~dispatch_batcher();
+
+    dispatch_batcher(const dispatch_batcher&) = delete;
+
+    dispatch_batcher& operator=(const dispatch_batcher&) = delete;
+
+    batched_job dispatch(compute_kernel& kernel, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants = {});
+
+    // queues arbitrary commands; they count as one dispatch against the budget
+    batched_job record(const std::function<void(VkCommandBuffer)>& recorder);
+
+    // makes shader writes of everything queued so far visible to what is queued next
+    void barrier();
+
+    // submits the open batch if its latency budget has run out
+    void poll();
+
+    void flush();
+
+private:
+    friend struct batched_job;
+
+    context& ctx;
+    submission_queue& queue;
+    std::uint32_t maxDispatches;
+    std::chrono::microseconds maxLatency;
+
+    std::vector<std::function<void(VkCommandBuffer)>> openRecorders;
+    // kernels the open batch dispatches, each once
+    std::vector<compute_kernel *> openKernels;
+    std::uint32_t openDispatchCount;
+    std::chrono::steady_clock::time_point openSince;
+    std::uint64_t openBatchId;
+
+    // futures of submitted batches, oldest first; batch ids below firstSubmittedId have completed
+    std::deque<job_future> submitted;
+    std::uint64_t firstSubmittedId;
+
+    bool isReady(std::uint64_t batchId);
+
+    void wait(std::uint64_t batchId);
+};
+
+#endif
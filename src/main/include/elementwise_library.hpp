@@ -0,0 +1,94 @@
+#ifndef ELEMENTWISE_LIBRARY_HPP_
+#define ELEMENTWISE_LIBRARY_HPP_
+
+#include "volk.h"
+
+#include "compute_kernel.hpp"
+#include "context.hpp"
+
+#include <cstdint>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// the 32-bit element types the library's kernels read and write
+enum class element_type {
+    f32,
+    i32,
+    u32
+};
+
+// One operation of the library. expression is GLSL over the inputs a, b, c and the parameters
+// p0, p1, all of the input type; see src/main/glsl/elementwise.comp for the rest of the template.
+struct elementwise_op {
+    std::string name;
+    std::uint32_t inputCount;
+    std::uint32_t parameterCount;
+    std::string expression;
+    // the input types the operation is defined for
+    std::vector<element_type> types;
+    // conversions write outputType whatever the input; every other operation keeps the input type
+    bool converts;
+    element_type outputType;
+};
+
+// Bandwidth-bound element-wise kernels generated from one GLSL template (elementwise.comp) and
+// looked up by operation name and input type. Each (name, type) variant is a SPIR-V file built by
+// the command getCompileCommand() returns; its compute_kernel is created on first use and kept.
+//
+// Every variant binds its inputs and output twice, like square.comp, and takes the same three
+// push constant words: the element count and the raw bits of p0 and p1. Not thread-safe.
+struct elementwise_library {
+    // parameters every variant receives, whether its expression uses them or not
+    static constexpr std::uint32_t MAX_PARAMETERS = 2;
+
+    elementwise_library(context& ctx, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+
+    elementwise_library(const elementwise_library&) = delete;
+
+    elementwise_library& operator=(const elementwise_library&) = delete;
+
+    static const std::vector<elementwise_op>& getOps();
+
+    // throws for names that are not in getOps()
+    static const elementwise_op& getOp(const std::string& name);
+
+    static element_type getOutputType(const elementwise_op& op, element_type type);
+
+    // "f32", "i32" or "u32"
+    static const char * getTypeName(element_type type);
+
+    // e.g. "add_f32.comp.spv"; conversions are named after both types, e.g. "to_i32_f32.comp.spv"
+    static std::string getSpvFileName(const elementwise_op& op, element_type type);
+
+    // the glslc command line, run from the repository root, that builds the variant's SPIR-V
+    static std::string getCompileCommand(const elementwise_op& op, element_type type);
+
+    // a parameter as the push constant word the kernels read it from
+    static std::uint32_t toParameter(float value);
+
+    static std::uint32_t toParameter(std::int32_t value);
+
+    static std::uint32_t toParameter(std::uint32_t value);
+
+    // the kernel for the operation over inputs of type; throws if the operation is not defined for it
+    compute_kernel& get(const std::string& name, element_type type);
+
+    // output[i] = name(inputs[0][i], ...) for i < count, on the first compute queue; waits for it.
+    // parameters are p0 and p1 as toParameter() words, as many as the operation takes.
+    void dispatch(const std::string& name, element_type type, const std::vector<VkBuffer>& inputs, VkBuffer output, std::uint32_t count, const std::vector<std::uint32_t>& parameters = {});
+
+    // forget()s the buffer in every kernel created so far
+    void forget(VkBuffer buffer);
+
+private:
+    context& ctx;
+    VkPipelineCache pipelineCache;
+    std::uint32_t workgroupSize;
+    std::map<std::pair<std::string, element_type>, std::unique_ptr<compute_kernel>> kernels;
+};
+
+#endif
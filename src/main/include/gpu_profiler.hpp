@@ -0,0 +1,97 @@
+#ifndef GPU_PROFILER_HPP_
+#define GPU_PROFILER_HPP_
+
+#include "volk.h"
+
+#include "context.hpp"
+#include "submission_queue.hpp"
+
+#include <chrono>
+#include <cstdint>
+
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Brackets recorded work with vkCmdWriteTimestamp and aggregates the device time per label.
+//
+// Attach one to context::profiler and compute_kernel, staging_ring and submission_queue time their
+// dispatches and copies automatically. Scopes recorded since the last endBatch() belong to the next
+// submission; collect() reads back the timestamps of every batch whose job has completed, together
+// with the host-side latency from just before vkQueueSubmit until the completion was first observed.
+// submission_queue reports every completion it sees, so collect() may run long after the fact
+// without inflating that latency.
+struct gpu_profiler {
+    static constexpr std::uint32_t DEFAULT_QUERY_COUNT = 4096;
+
+    struct statistics {
+        std::size_t count;
+        double minMs;
+        double meanMs;
+        double p99Ms;
+    };
+
+    gpu_profiler(context& ctx, std::uint32_t queueFamilyIndex, std::uint32_t queryCount = DEFAULT_QUERY_COUNT);
+
+    ~gpu_profiler();
+
+    gpu_profiler(const gpu_profiler&) = delete;
+
+    gpu_profiler& operator=(const gpu_profiler&) = delete;
+
+    // false when the queue family has no timestampValidBits; begin/end then record nothing
+    bool isSupported() const;
+
+    // returns a scope id to pass to end(); both must be recorded into the same command buffer
+    std::uint32_t begin(VkCommandBuffer commandBuffer, const std::string& label);
+
+    void end(VkCommandBuffer commandBuffer, std::uint32_t scope);
+
+    // ties every scope recorded since the previous call to the submission that executes them;
+    // submitTime is when the host began submitting it, so the submit counts toward the latency
+    void endBatch(const job_future& completion, std::chrono::steady_clock::time_point submitTime = std::chrono::steady_clock::now());
+
+    // stamps the completion time of every batch whose job has completed since the last call
+    void observeCompletions();
+
+    // harvests finished batches without blocking
+    void collect();
+
+    statistics getDeviceStatistics(const std::string& label) const;
+
+    statistics getHostStatistics(const std::string& label) const;
+
+    void report(std::ostream& out) const;
+
+private:
+    struct scope {
+        std::string label;
+        std::uint32_t query;
+    };
+
+    struct batch {
+        std::vector<scope> scopes;
+        job_future completion;
+        std::chrono::steady_clock::time_point submitTime;
+        std::chrono::steady_clock::time_point completionTime;
+        bool completed;
+    };
+
+    context& ctx;
+    VkQueryPool queryPool;
+    std::uint32_t queryCount;
+    std::uint64_t timestampMask;
+    double msPerTick;
+    std::vector<std::uint32_t> freeQueries;
+    std::vector<scope> openScopes;
+    std::deque<batch> batches;
+    bool observing;
+    std::map<std::string, std::vector<double>> deviceSamples;
+    std::map<std::string, std::vector<double>> hostSamples;
+
+    static statistics summarize(std::vector<double> samples);
+};
+
+#endif
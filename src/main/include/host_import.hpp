@@ -0,0 +1,52 @@
+#ifndef HOST_IMPORT_HPP_
+#define HOST_IMPORT_HPP_
+
+#include "volk.h"
+
+#include "context.hpp"
+
+#include <cstdint>
+
+// A range of host memory, e.g. a mapped_file, imported as VkDeviceMemory with
+// VK_EXT_external_memory_host, so the device reads and writes it in place without a copy.
+//
+// Only usable when context::minImportedHostPointerAlignment is non-zero; pHost and size must both
+// be multiples of it. The host memory must outlive the import and every buffer created from it.
+// Drivers may still refuse a particular range, e.g. file-backed pages, in which case the
+// constructor throws and the caller should fall back to copying.
+//
+// The memory type is one a storage buffer can be bound to, coherent where possible. Otherwise the
+// import is mapped, and flush() and invalidate() bracket the device's use of it.
+struct host_import {
+    static bool isSupported(const context& ctx, const void * pHost, VkDeviceSize size);
+
+    host_import(context& ctx, void * pHost, VkDeviceSize size);
+
+    ~host_import();
+
+    host_import(const host_import&) = delete;
+
+    host_import& operator=(const host_import&) = delete;
+
+    // a buffer bound to [offset, offset + size) of the import; the caller destroys it.
+    // offset must satisfy the buffer's alignment requirement.
+    VkBuffer createBuffer(VkDeviceSize offset, VkDeviceSize size, VkBufferUsageFlags usage) const;
+
+    // makes host writes to [offset, offset + size) visible to the device; a no-op for coherent memory
+    void flush(VkDeviceSize offset, VkDeviceSize size) const;
+
+    // makes device writes to [offset, offset + size) visible to the host; a no-op for coherent memory
+    void invalidate(VkDeviceSize offset, VkDeviceSize size) const;
+
+private:
+    context& ctx;
+    VkDeviceSize size;
+    VkDeviceMemory memory;
+    std::uint32_t memoryTypeIndex;
+    // only set for non-coherent types, which need the memory mapped to flush and invalidate
+    void * pMapped;
+
+    VkMappedMemoryRange getMappedRange(VkDeviceSize offset, VkDeviceSize size) const;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef JOB_SYSTEM_HPP_
+#define JOB_SYSTEM_HPP_
+
+#include "volk.h"
+
+#include "compute_kernel.hpp"
+#include "context.hpp"
+
+#include <cstdint>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct job_system;
+
+// Completion handle for a job_system job; copies share the same job. Safe to use from any thread.
+// A default-constructed handle is already complete.
+struct job_handle {
+    job_handle();
+
+    bool isReady() const;
+
+    void wait() const;
+
+private:
+    friend struct job_system;
+
+    struct state {
+        std::atomic<bool> done;
+    };
+
+    job_system * system;
+    std::shared_ptr<state> pState;
+};
+
+// What a job's recorder gets: the command buffer to record into and descriptor sets that live
+// exactly as long as the job.
+struct job_recorder {
+    VkCommandBuffer commandBuffer;
+
+    // at most job_system::DESCRIPTOR_SETS_PER_JOB sets per job
+    VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout layout);
+
+private:
+    friend struct job_system;
+
+    context * ctx;
+    VkDescriptorPool descriptorPool;
+};
+
+// Accepts compute jobs from any number of host threads and feeds them to one VkQueue.
+//
+// Each submitting thread records into command buffers and descriptor pools of its own, created on
+// its first submit and recycled once their jobs complete, so recording never takes a shared lock.
+// Finished command buffers are pushed onto a lock-free multi-producer stack; a dedicated submit
+// thread drains it, hands everything it found to a single vkQueueSubmit with one fence, and marks
+// the jobs complete when the fence signals. The job system owns the queue it was given: nothing
+// else may submit to (familyIndex, queueIndex) while it exists.
+//
+// Jobs are not profiled, since gpu_profiler is single-threaded. Every thread that submitted must
+// have stopped doing so before the job system is destroyed.
+struct job_system {
+    static constexpr std::uint32_t DESCRIPTOR_SETS_PER_JOB = 16;
+    static constexpr std::uint32_t STORAGE_BUFFERS_PER_JOB = 64;
+
+    job_system(context& ctx, std::uint32_t queueFamilyIndex, std::uint32_t queueIndex = 0);
+
+    // waits for every submitted job, then releases all per-thread resources
+    ~job_system();
+
+    job_system(const job_system&) = delete;
+
+    job_system& operator=(const job_system&) = delete;
+
+    // records on the calling thread and queues the job for the submit thread
+    job_handle submit(const std::function<void(job_recorder&)>& recorder);
+
+    // a single dispatch of kernel with a descriptor set owned by the job, or pushed descriptors
+    job_handle submit(const compute_kernel& kernel, const std::vector<VkBuffer>& buffers, std::uint32_t groupCount, const std::vector<std::uint32_t>& pushConstants = {});
+
+private:
+    friend struct job_handle;
+
+    struct job_slot {
+        VkCommandBuffer commandBuffer;
+        VkDescriptorPool descriptorPool;
+        std::shared_ptr<job_handle::state> pState;
+    };
+
+    // owned by one submitting thread; only that thread touches its pools
+    struct thread_resources {
+        VkCommandPool commandPool;
+        std::vector<job_slot> slots;
+    };
+
+    struct pending_job {
+        VkCommandBuffer commandBuffer;
+        std::shared_ptr<job_handle::state> pState;
+        pending_job * next;
+    };
+
+    struct batch {
+        VkFence fence;
+        std::vector<std::shared_ptr<job_handle::state>> jobs;
+    };
+
+    context& ctx;
+    std::uint64_t id;
+    std::uint32_t queueFamilyIndex;
+    VkQueue queue;
+
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<thread_resources>> threads;
+
+    std::atomic<pending_job *> pendingHead;
+    std::atomic<bool> stopping;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+
+    std::mutex completionMutex;
+    std::condition_variable completionCondition;
+
+    // used by the submit thread only
+    std::deque<batch> inFlight;
+    std::vector<VkFence> freeFences;
+    std::thread submitThread;
+
+    thread_resources& getThreadResources();
+
+    job_slot& acquireSlot(thread_resources& resources);
+
+    void run();
+
+    void submitPending();
+
+    void retire();
+
+    void wait(const job_handle::state& s);
+};
+
+#endif
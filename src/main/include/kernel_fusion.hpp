@@ -0,0 +1,123 @@
+#ifndef KERNEL_FUSION_HPP_
+#define KERNEL_FUSION_HPP_
+
+#include "volk.h"
+
+#include "compute_kernel.hpp"
+#include "context.hpp"
+#include "elementwise_library.hpp"
+
+#include <cstdint>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A chain (or tree) of elementwise_library operations over numbered input buffers, e.g.
+//
+//     auto x = elementwise_expression::input(0, element_type::f32);
+//     auto y = x.apply("square").apply("scale", {}, {toParameter(2.0F)}).apply("add", {x});
+//
+// Expressions are immutable values; sub-expressions may be shared, and are evaluated once.
+struct elementwise_expression {
+    static elementwise_expression input(std::uint32_t index, element_type type);
+
+    // op(*this, operands...) with the operation's parameters as toParameter() words; throws if
+    // the operand count, parameter count or types do not fit the operation
+    elementwise_expression apply(const std::string& opName, const std::vector<elementwise_expression>& operands = {}, const std::vector<std::uint32_t>& parameters = {}) const;
+
+    element_type getType() const;
+
+private:
+    friend struct elementwise_fuser;
+
+    struct node {
+        // nullptr for inputs
+        const elementwise_op * op;
+        element_type type;
+        std::uint32_t inputIndex;
+        std::vector<std::shared_ptr<const node>> operands;
+        std::vector<std::uint32_t> parameters;
+    };
+
+    std::shared_ptr<const node> root;
+
+    explicit elementwise_expression(std::shared_ptr<const node> root);
+};
+
+// Turns a whole elementwise_expression into one generated compute shader, so a chain of n
+// operations reads each input and writes the output once instead of making n passes over memory.
+//
+// Parameter values are push constants rather than part of the source, so expressions of the same
+// shape share a kernel. Generated shaders are compiled by a compile_function and kept in
+// cacheDirectory as fused_<hash>.comp and .spv, named after a 64-bit FNV-1a hash of the source; a
+// later run (or a later expression of the same shape) loads the SPIR-V instead of compiling again.
+// The default compileWithGlslc needs glslc on the PATH at run time. Not thread-safe.
+struct elementwise_fuser {
+    // compiles the GLSL file sourceFileName to SPIR-V at spvFileName; throws on failure
+    using compile_function = std::function<void(const std::string& sourceFileName, const std::string& spvFileName)>;
+
+    elementwise_fuser(context& ctx, const std::string& cacheDirectory = ".", VkPipelineCache pipelineCache = VK_NULL_HANDLE, compile_function compile = compileWithGlslc);
+
+    elementwise_fuser(const elementwise_fuser&) = delete;
+
+    elementwise_fuser& operator=(const elementwise_fuser&) = delete;
+
+    // runs glslc from the PATH through std::system; refuses file names holding anything but
+    // letters, digits, spaces and /\._-+:~, so they cannot escape the command line's quoting
+    static void compileWithGlslc(const std::string& sourceFileName, const std::string& spvFileName);
+
+    // the GLSL of the fused kernel; bindings and push constants follow elementwise.comp, with any
+    // number of inputs and one push constant word per parameter of the whole expression
+    static std::string generateSource(const elementwise_expression& expression);
+
+    // the fused kernel, compiled or loaded on first use; throws if the expression needs more
+    // storage buffers or push constant bytes than the device allows
+    compute_kernel& get(const elementwise_expression& expression);
+
+    // output[i] = expression(inputs[0][i], ...) for i < count, on the first compute queue; waits for it
+    void dispatch(const elementwise_expression& expression, const std::vector<VkBuffer>& inputs, VkBuffer output, std::uint32_t count);
+
+    // forget()s the buffer in every kernel created so far
+    void forget(VkBuffer buffer);
+
+    // how many shaders this fuser had to compile rather than find in memory or in cacheDirectory
+    std::uint32_t getCompileCount() const;
+
+private:
+    using node = elementwise_expression::node;
+
+    // what a dispatch needs of an expression, worked out once per expression
+    struct layout {
+        compute_kernel * pKernel;
+        std::uint32_t inputCount;
+        // operation nodes in the order their parameters are pushed; kept alive by the root
+        std::vector<const node *> nodes;
+    };
+
+    context& ctx;
+    std::string cacheDirectory;
+    VkPipelineCache pipelineCache;
+    compile_function compile;
+    std::uint32_t workgroupSize;
+    std::uint32_t compileCount;
+    // keyed by the generated source itself, so hash collisions cannot mix kernels up
+    std::unordered_map<std::string, std::unique_ptr<compute_kernel>> kernels;
+    // keyed by root node; the weak pointer tells a live root from a new one at a freed root's address
+    std::unordered_map<const node *, std::pair<std::weak_ptr<const node>, layout>> layouts;
+    std::size_t prunedLayoutCount;
+
+    // every distinct operation node below root, operands before their users
+    static std::vector<const node *> sortNodes(const elementwise_expression& expression);
+
+    // the type of every input index; throws if an index is skipped or used with two types
+    static std::vector<element_type> getInputTypes(const elementwise_expression& expression);
+
+    const layout& getLayout(const elementwise_expression& expression);
+
+    std::vector<char> loadOrCompile(const std::string& source);
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MAPPED_FILE_HPP_
+#define MAPPED_FILE_HPP_
+
+#include <cstdint>
+
+#include <string>
+
+// A whole file mapped into the address space.
+//
+// The mapping always covers whole pages, so getMappedSize() is getSize() rounded up to the page
+// size; the bytes past the end of the file read as zero. Input mappings are private and writable:
+// writes never reach the file, but the pages can be imported into Vulkan, which some drivers only
+// allow for writable memory. Output mappings are shared, so whatever is written lands in the file.
+struct mapped_file {
+    // maps an existing file for reading
+    static mapped_file openInput(const std::string& path);
+
+    // creates (or truncates) a file of size bytes and maps it for writing
+    static mapped_file createOutput(const std::string& path, std::uint64_t size);
+
+    mapped_file(mapped_file&& other);
+
+    // unmaps, and trims an output file back from whole pages to its size
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file& operator=(mapped_file&&) = delete;
+
+    void * getData() const;
+
+    std::uint64_t getSize() const;
+
+    std::uint64_t getMappedSize() const;
+
+    static std::uint64_t getPageSize();
+
+private:
+    std::string path;
+    void * pData;
+    std::uint64_t size;
+    std::uint64_t mappedSize;
+    bool output;
+
+    mapped_file(const std::string& path, std::uint64_t size, bool output);
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef MEMORY_ARENA_HPP_
+#define MEMORY_ARENA_HPP_
+
+#include "volk.h"
+
+#include <cstdint>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Linear resources (buffers) and optimal-tiling images must be kept bufferImageGranularity apart
+// when they share a VkDeviceMemory block.
+enum class resource_kind {
+    linear,
+    optimal
+};
+
+struct memory_allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    std::uint32_t memoryTypeIndex = 0;
+    void * block = nullptr;
+    // host address of offset for HOST_VISIBLE types, valid until the allocation is freed; nullptr otherwise
+    void * pMapped = nullptr;
+};
+
+struct memory_arena_statistics {
+    std::uint32_t blockCount = 0;
+    std::uint32_t allocationCount = 0;
+    std::uint32_t freeRangeCount = 0;
+    VkDeviceSize blockBytes = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize freeBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+
+    // 0 when all free space is contiguous, approaching 1 as it splinters into small ranges.
+    double fragmentation() const;
+};
+
+// All public members are thread-safe; one mutex guards the blocks and is held only while ranges
+// are searched or released, or while a new block is allocated.
+//
+// Blocks of HOST_VISIBLE types are mapped once when they are created and stay mapped, so every
+// allocation from them carries its host pointer. Allocations from non-coherent types are padded
+// to whole nonCoherentAtomSize units, which lets flush() and invalidate() round their ranges out
+// without touching a neighbouring allocation.
+struct memory_arena {
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+    // allocateFlags are VkMemoryAllocateFlags given to every block, e.g. the device address bit
+    memory_arena(VkDevice device, const VolkDeviceTable& vk, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE, VkFlags allocateFlags = 0);
+
+    ~memory_arena();
+
+    memory_arena(const memory_arena&) = delete;
+
+    memory_arena& operator=(const memory_arena&) = delete;
+
+    memory_allocation allocate(const VkMemoryRequirements& requirements, std::uint32_t memoryTypeIndex, resource_kind kind = resource_kind::linear);
+
+    void free(const memory_allocation& allocation);
+
+    // makes host writes to [offset, offset + size) of the allocation visible to the device;
+    // does nothing for HOST_COHERENT types
+    void flush(const memory_allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
+
+    // makes device writes to [offset, offset + size) of the allocation visible to the host;
+    // does nothing for HOST_COHERENT types
+    void invalidate(const memory_allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
+
+    memory_arena_statistics getStatistics(std::uint32_t memoryTypeIndex) const;
+
+    memory_arena_statistics getStatistics() const;
+
+    // bytes of VkDeviceMemory the arena holds in each memory heap
+    std::vector<VkDeviceSize> getHeapBlockBytes() const;
+
+    // bytes of new VkDeviceMemory that allocate() would need for size bytes of the type: 0 when a
+    // shared block has a free range that large, otherwise the block it would create
+    VkDeviceSize getNewBlockBytes(VkDeviceSize size, std::uint32_t memoryTypeIndex) const;
+
+private:
+    struct range {
+        VkDeviceSize size;
+        bool free;
+        resource_kind kind;
+    };
+
+    struct block {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        std::uint32_t memoryTypeIndex;
+        std::uint32_t allocationCount;
+        bool dedicated;
+        // the whole block, for HOST_VISIBLE types
+        char * pMapped;
+        // every byte of the block is covered by exactly one range, keyed by offset
+        std::map<VkDeviceSize, range> ranges;
+
+        bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize granularity, resource_kind kind, memory_allocation& out);
+
+        void release(VkDeviceSize offset);
+    };
+
+    VkDevice device;
+    const VolkDeviceTable& vk;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize bufferImageGranularity;
+    VkDeviceSize nonCoherentAtomSize;
+    std::uint32_t maxMemoryAllocationCount;
+    std::uint32_t deviceAllocationCount;
+    VkDeviceSize blockSize;
+    VkFlags allocateFlags;
+    std::vector<std::unique_ptr<block>> blocks[VK_MAX_MEMORY_TYPES];
+    mutable std::mutex mutex;
+
+    memory_arena_statistics collectStatistics(std::uint32_t memoryTypeIndex) const;
+
+    bool isNonCoherent(std::uint32_t memoryTypeIndex) const;
+
+    // size padded to whole non-coherent atoms where the type needs it
+    VkDeviceSize getPaddedSize(VkDeviceSize size, std::uint32_t memoryTypeIndex) const;
+
+    // small heaps (e.g. 256MB BAR windows) get proportionally smaller blocks
+    VkDeviceSize getPreferredBlockSize(std::uint32_t memoryTypeIndex) const;
+
+    // the allocation's subrange widened to whole non-coherent atoms
+    VkMappedMemoryRange getMappedRange(const memory_allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+    block * createBlock(std::uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated);
+
+    void destroyBlock(std::uint32_t memoryTypeIndex, block * pBlock);
+};
+
+#endif
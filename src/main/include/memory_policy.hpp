@@ -0,0 +1,29 @@
+#ifndef MEMORY_POLICY_HPP_
+#define MEMORY_POLICY_HPP_
+
+#include "volk.h"
+
+// Which memory types an allocation may use, and which of those it would rather have.
+//
+// context::getMemoryTypeIndex() drops every type that lacks a required flag or has a forbidden one.
+// Of the rest it picks, in order of precedence: a type whose heap still has budget for the memory
+// the request would make the arena allocate, the most preferred flags, the fewest flags the policy
+// does not mention (so a GPU-only buffer stays out of the small host-visible BAR heap), and finally
+// the most budget left in the heap. DEVICE_LOCAL is not counted as preferred on a host-visible type
+// for requests above a quarter of its heap.
+struct memory_policy {
+    VkMemoryPropertyFlags required;
+    VkMemoryPropertyFlags preferred;
+    VkMemoryPropertyFlags forbidden;
+
+    // only the device touches it
+    static memory_policy gpuOnly();
+
+    // the host writes it, the device reads it; device-local wherever the host can see such memory
+    static memory_policy upload();
+
+    // the device writes it, the host reads it; cached so the reads run at memory speed
+    static memory_policy readbackCached();
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef MULTI_DEVICE_HPP_
+#define MULTI_DEVICE_HPP_
+
+#include "volk.h"
+
+#include "context.hpp"
+
+#include <cstdint>
+
+#include <memory>
+#include <vector>
+
+// One context per physical device with a compute queue on a shared instance, plus a
+// throughput-weighted split of the work.
+//
+// Device groups (vkEnumeratePhysicalDeviceGroups) are Vulkan 1.1 and only cover linked adapters, so
+// every GPU gets a logical device of its own and the host moves each share of the data in and out.
+//
+// partition() hands every device a contiguous range sized by the throughput recorded for it with
+// recordThroughput(); until every device has been measured the split is even.
+struct multi_device {
+    struct range {
+        std::uint64_t offset;
+        std::uint64_t count;
+    };
+
+    // elements a throughput measurement should cover (32MB of floats), so that it times memory
+    // bandwidth rather than submit overhead
+    static constexpr std::uint64_t CALIBRATION_ELEMENTS = 8 * 1024 * 1024;
+
+    std::vector<std::unique_ptr<context>> contexts;
+
+    multi_device();
+
+    ~multi_device();
+
+    multi_device(const multi_device&) = delete;
+
+    multi_device& operator=(const multi_device&) = delete;
+
+    // one range per context, in the same order; ranges are multiples of granularity except the last
+    std::vector<range> partition(std::uint64_t count, std::uint64_t granularity = 1) const;
+
+    // folds a run of count elements that took the given time on contexts[device] into its estimate;
+    // runs much shorter than CALIBRATION_ELEMENTS mostly measure launch latency
+    void recordThroughput(std::size_t device, std::uint64_t count, double milliseconds);
+
+private:
+    VkInstance instance;
+    // elements per millisecond; 0 until measured
+    std::vector<double> throughput;
+};
+
+#endif
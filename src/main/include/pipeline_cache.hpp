@@ -0,0 +1,39 @@
+#ifndef PIPELINE_CACHE_HPP_
+#define PIPELINE_CACHE_HPP_
+
+#include "volk.h"
+
+#include "context.hpp"
+
+#include <string>
+#include <vector>
+
+// VkPipelineCache backed by a file. The file is only used to seed the cache if its
+// VkPipelineCacheHeaderVersionOne matches this device's vendorID, deviceID and pipelineCacheUUID;
+// anything else (missing, truncated, other GPU, other driver build) starts from an empty cache.
+struct pipeline_cache {
+    VkPipelineCache cache;
+
+    pipeline_cache(context& ctx, const std::string& fileName);
+
+    // writes the cache back to disk
+    ~pipeline_cache();
+
+    pipeline_cache(const pipeline_cache&) = delete;
+
+    pipeline_cache& operator=(const pipeline_cache&) = delete;
+
+    void save() const;
+
+    // true if the cache was seeded from the file
+    bool isWarm() const;
+
+private:
+    context& ctx;
+    std::string fileName;
+    bool warm;
+
+    bool isCompatible(const std::vector<char>& data) const;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef QUEUE_SCHEDULER_HPP_
+#define QUEUE_SCHEDULER_HPP_
+
+#include "volk.h"
+
+#include "context.hpp"
+#include "submission_queue.hpp"
+
+#include <cstdint>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Wraps every queue created by context in a submission_queue and spreads work across them.
+//
+// Independent dispatches go round-robin over the queues of all compute families, so hardware with
+// async-compute queues runs them concurrently. Copies go round-robin over the queues of the first
+// transfer-only (DMA) family, or share the compute queues when the device has none. Jobs on different queues are not
+// ordered against each other; when one stage consumes another's output, wait on the producer's
+// job_future before submitting the consumer. Buffers used from several families should be created
+// with context::shareAcrossQueueFamilies().
+struct queue_scheduler {
+    queue_scheduler(context& ctx, std::uint32_t slotCount = submission_queue::DEFAULT_SLOT_COUNT);
+
+    queue_scheduler(const queue_scheduler&) = delete;
+
+    queue_scheduler& operator=(const queue_scheduler&) = delete;
+
+    // true when copies run on a dedicated transfer family rather than sharing the compute queues
+    bool hasDedicatedTransfer() const;
+
+    // the family whose queues transferQueue() returns, e.g. for staging_ring
+    std::uint32_t getTransferQueueFamilyIndex() const;
+
+    std::size_t getComputeQueueCount() const;
+
+    // the next compute queue in round-robin order
+    submission_queue& computeQueue();
+
+    // the next transfer queue in round-robin order
+    submission_queue& transferQueue();
+
+    job_future submitCompute(const std::function<void(VkCommandBuffer)>& recorder);
+
+    job_future submitTransfer(const std::function<void(VkCommandBuffer)>& recorder);
+
+    void waitIdle();
+
+private:
+    std::vector<std::unique_ptr<submission_queue>> computeQueues;
+    std::vector<std::unique_ptr<submission_queue>> transferQueues;
+    std::size_t nextCompute;
+    std::size_t nextTransfer;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef RADIX_SORT_HPP_
+#define RADIX_SORT_HPP_
+
+#include "volk.h"
+
+#include "compute_kernel.hpp"
+#include "context.hpp"
+#include "elementwise_library.hpp"
+#include "memory_arena.hpp"
+#include "scan.hpp"
+#include "submission_queue.hpp"
+
+#include <cstdint>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Sorts 32-bit keys on the device, optionally carrying a 32-bit payload per key.
+//
+// An LSD radix sort over four 8-bit digits, each pass a histogram of every tile's digits, an
+// exclusive scan of the counts (prefix_scan) and a stable scatter, all recorded into one
+// submission. The passes ping-pong between the caller's buffers and scratch buffers from the
+// context's arena, so the sorted keys end up back in the caller's buffer. i32 and f32 keys sort
+// by value; for floats, -0 sorts before +0 and NaNs go to the ends by sign. Kernels come from
+// radix_sort.comp; the scatter ranks keys with subgroup ballots where context::subgroupBallot is
+// set and in fixed-size chunks of shared memory elsewhere. Not thread-safe.
+struct radix_sorter {
+    // keys each invocation handles per tile; must match ITEMS in radix_sort.comp
+    static constexpr std::uint32_t ITEMS_PER_INVOCATION = 8;
+
+    static constexpr std::uint32_t RADIX = 256;
+
+    static constexpr std::uint32_t PASS_COUNT = 4;
+
+    radix_sorter(context& ctx, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+
+    ~radix_sorter();
+
+    radix_sorter(const radix_sorter&) = delete;
+
+    radix_sorter& operator=(const radix_sorter&) = delete;
+
+    // "radix_histogram.comp.spv", or e.g. "radix_scatter_payload_subgroup.comp.spv" for a scatter
+    static std::string getSpvFileName(bool scatter, bool withPayloads, bool subgroup);
+
+    // the glslc command lines, run from the repository root, that build every kernel's SPIR-V
+    static std::vector<std::string> getCompileCommands();
+
+    // sorts the first count keys in ascending order, and payloads, unless VK_NULL_HANDLE, along with
+    // them; equal keys keep their order. Waits for the result.
+    void sort(element_type keyType, VkBuffer keys, std::uint32_t count, VkBuffer payloads = VK_NULL_HANDLE);
+
+    // allocates what record() needs for up to count keys; no recorded sort may still be executing,
+    // since smaller scratch buffers are replaced
+    void prepare(std::uint32_t count, bool withPayloads);
+
+    // bracket record() calls the way compute_kernel's recording sessions do; job executes every
+    // command buffer recorded in between
+    void beginRecording();
+
+    void endRecording(const job_future& job);
+
+    // records sort() into a caller-owned command buffer, after prepare() with at least count and
+    // withPayloads if payloads are given, and inside a recording session. The caller synchronizes
+    // the buffers with what comes before and after it.
+    void record(VkCommandBuffer commandBuffer, element_type keyType, VkBuffer keys, std::uint32_t count, VkBuffer payloads = VK_NULL_HANDLE);
+
+    // forget()s the buffer in every kernel created so far
+    void forget(VkBuffer buffer);
+
+private:
+    struct scratch_buffer {
+        VkBuffer buffer;
+        memory_allocation memory;
+        VkDeviceSize size;
+    };
+
+    context& ctx;
+    VkPipelineCache pipelineCache;
+    std::uint32_t workgroupSize;
+    bool subgroup;
+    submission_queue queue;
+    prefix_scan scans;
+    scratch_buffer counts;
+    scratch_buffer scratchKeys;
+    scratch_buffer scratchPayloads;
+    std::unique_ptr<compute_kernel> histogramKernel;
+    std::unique_ptr<compute_kernel> scatterKernel;
+    std::unique_ptr<compute_kernel> payloadScatterKernel;
+    std::uint32_t openRecordings;
+
+    std::uint32_t getTileCount(std::uint32_t count) const;
+
+    compute_kernel& getKernel(std::unique_ptr<compute_kernel>& kernel, const std::string& spvFileName, std::uint32_t bindingCount);
+
+    // makes sure scratch holds size bytes, replacing a smaller buffer
+    void reserve(scratch_buffer& scratch, VkDeviceSize size);
+
+    void destroy(scratch_buffer& scratch);
+};
+
+#endif
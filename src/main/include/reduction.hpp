@@ -0,0 +1,82 @@
+#ifndef REDUCTION_HPP_
+#define REDUCTION_HPP_
+
+#include "volk.h"
+
+#include "compute_kernel.hpp"
+#include "context.hpp"
+#include "elementwise_library.hpp"
+#include "memory_arena.hpp"
+#include "submission_queue.hpp"
+
+#include <cstdint>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+
+enum class reduce_op {
+    sum,
+    min,
+    max,
+    // the sum of the products of two inputs
+    dot
+};
+
+// Reduces a buffer to one value on the device, so only that value is read back.
+//
+// The first pass caps its grid at PARTIALS_PER_INVOCATION * workgroupSize workgroups, each of which
+// writes one partial result; the second pass folds those in a single workgroup. Both are recorded
+// into one submission. Kernels come from reduce.comp; they combine within subgroups where
+// context::subgroupArithmetic is set and through a shared-memory tree elsewhere. The partial and
+// result buffers are allocated once. Not thread-safe.
+struct reducer {
+    // partial results the second pass reads per invocation, as one 4-vector
+    static constexpr std::uint32_t PARTIALS_PER_INVOCATION = 4;
+
+    reducer(context& ctx, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+
+    ~reducer();
+
+    reducer(const reducer&) = delete;
+
+    reducer& operator=(const reducer&) = delete;
+
+    // "sum", "min", "max" or "dot"
+    static const char * getOpName(reduce_op op);
+
+    // e.g. "reduce_sum_f32.comp.spv", or "reduce_sum_f32_subgroup.comp.spv"
+    static std::string getSpvFileName(reduce_op op, element_type type, bool subgroup);
+
+    // the glslc command line, run from the repository root, that builds the variant's SPIR-V
+    static std::string getCompileCommand(reduce_op op, element_type type, bool subgroup);
+
+    // op over the first count elements of input (and of second for dot) as a value of type, in its
+    // raw 32-bit form; sums and dot products of integers wrap around. Waits for the result.
+    std::uint32_t reduce(reduce_op op, element_type type, VkBuffer input, std::uint32_t count, VkBuffer second = VK_NULL_HANDLE);
+
+    // a reduce() result of an f32 reduction
+    static float toFloat(std::uint32_t bits);
+
+    // forget()s the buffer in every kernel created so far
+    void forget(VkBuffer buffer);
+
+private:
+    context& ctx;
+    VkPipelineCache pipelineCache;
+    std::uint32_t workgroupSize;
+    bool subgroup;
+    submission_queue queue;
+    VkBuffer partialsBuffer;
+    memory_allocation partialsMemory;
+    VkBuffer resultBuffer;
+    memory_allocation resultMemory;
+    std::map<std::tuple<reduce_op, element_type>, std::unique_ptr<compute_kernel>> kernels;
+
+    compute_kernel& getKernel(reduce_op op, element_type type);
+
+    VkBuffer createBuffer(VkDeviceSize size, const memory_policy& policy, memory_allocation& memory);
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SCAN_HPP_
+#define SCAN_HPP_
+
+#include "volk.h"
+
+#include "compute_kernel.hpp"
+#include "context.hpp"
+#include "elementwise_library.hpp"
+#include "memory_arena.hpp"
+#include "submission_queue.hpp"
+
+#include <cstdint>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Prefix sums and stream compaction on the device.
+//
+// A scan is multi-level: the first pass scans blocks of ITEMS_PER_INVOCATION * workgroupSize
+// elements and writes one total per block, the totals are scanned the same way (recursively, while
+// they span more than one block), and a last pass adds them back onto the blocks. Every pass of a
+// call is recorded into one submission. The block totals, compaction destinations and kept count
+// live in scratch buffers from the context's arena, which grow as needed and are reused between
+// calls. Kernels come from scan.comp and compact.comp, with subgroup scans where
+// context::subgroupArithmetic is set. Not thread-safe.
+struct prefix_scan {
+    // elements each invocation scans sequentially; must match ITEMS in scan.comp
+    static constexpr std::uint32_t ITEMS_PER_INVOCATION = 4;
+
+    prefix_scan(context& ctx, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+
+    ~prefix_scan();
+
+    prefix_scan(const prefix_scan&) = delete;
+
+    prefix_scan& operator=(const prefix_scan&) = delete;
+
+    // e.g. "scan_u32.comp.spv" for the block scan, "scan_add_u32_subgroup.comp.spv" for the add pass
+    static std::string getSpvFileName(bool addPass, element_type type, bool subgroup);
+
+    // the glslc command lines, run from the repository root, that build every kernel's SPIR-V
+    static std::vector<std::string> getCompileCommands();
+
+    // output[i] = input[0] + ... + input[i], or up to input[i - 1] when exclusive, for i < count;
+    // output may be input. Waits for the result.
+    void scan(element_type type, VkBuffer input, VkBuffer output, std::uint32_t count, bool exclusive);
+
+    // allocates what record() needs for scans of up to count elements; no recorded scan may still be
+    // executing, since smaller scratch buffers are replaced
+    void prepare(std::uint32_t count);
+
+    // bracket record() calls the way compute_kernel's recording sessions do; job executes every
+    // command buffer recorded in between
+    void beginRecording();
+
+    void endRecording(const job_future& job);
+
+    // records scan() into a caller-owned command buffer, after prepare() with at least count and
+    // inside a recording session. The caller synchronizes the buffers with what comes before and
+    // after it.
+    void record(VkCommandBuffer commandBuffer, element_type type, VkBuffer input, VkBuffer output, std::uint32_t count, bool exclusive);
+
+    // copies, in order, the values whose u32 flag is 1 to the front of output and returns how many
+    // there were; every flag must be 0 or 1, and values are moved as raw 32-bit words. Waits for the result.
+    std::uint32_t compact(VkBuffer values, VkBuffer flags, VkBuffer output, std::uint32_t count);
+
+    // forget()s the buffer in every kernel created so far
+    void forget(VkBuffer buffer);
+
+private:
+    struct scratch_buffer {
+        VkBuffer buffer;
+        memory_allocation memory;
+        VkDeviceSize size;
+    };
+
+    context& ctx;
+    VkPipelineCache pipelineCache;
+    std::uint32_t workgroupSize;
+    bool subgroup;
+    submission_queue queue;
+    // block totals of each level
+    std::vector<scratch_buffer> levels;
+    scratch_buffer destinations;
+    scratch_buffer kept;
+    std::map<std::pair<bool, element_type>, std::unique_ptr<compute_kernel>> kernels;
+    std::unique_ptr<compute_kernel> compactKernel;
+    std::uint32_t openRecordings;
+
+    compute_kernel& getKernel(bool addPass, element_type type);
+
+    compute_kernel& getCompactKernel();
+
+    // a kernel created inside recording sessions joins every open one
+    compute_kernel& joinRecordings(compute_kernel& kernel);
+
+    // makes sure scratch holds size bytes, replacing a smaller buffer
+    void reserve(scratch_buffer& scratch, VkDeviceSize size, const memory_policy& policy);
+
+    void destroy(scratch_buffer& scratch);
+
+    void recordScan(VkCommandBuffer commandBuffer, element_type type, VkBuffer input, VkBuffer output, std::uint32_t count, bool exclusive, std::size_t level);
+};
+
+#endif
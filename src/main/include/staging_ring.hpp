@@ -0,0 +1,67 @@
+#ifndef STAGING_RING_HPP_
+#define STAGING_RING_HPP_
+
+#include "volk.h"
+
+#include "context.hpp"
+#include "submission_queue.hpp"
+
+#include <cstdint>
+
+#include <deque>
+
+// Host-visible ring buffer used to move data in and out of DEVICE_LOCAL buffers.
+//
+// upload/readback record transfer commands plus the barriers that order them against compute work.
+// Every range handed out belongs to the current batch; once the commands are submitted, endBatch()
+// ties the batch to the submission's job_future and the ring reclaims its space when the job completes.
+//
+// queueFamilyIndex names the family whose queues execute the recorded copies. For a transfer-only
+// family the compute-side barriers are left out: the compute work runs in a separate submission on
+// another queue, ordered by the host waiting on the job_future in between.
+struct staging_ring {
+    static constexpr VkDeviceSize DEFAULT_CAPACITY = 32 * 1024 * 1024;
+
+    // VK_QUEUE_FAMILY_IGNORED stands for the first compute family
+    staging_ring(context& ctx, VkDeviceSize capacity = DEFAULT_CAPACITY, std::uint32_t queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
+
+    ~staging_ring();
+
+    staging_ring(const staging_ring&) = delete;
+
+    staging_ring& operator=(const staging_ring&) = delete;
+
+    // copies data into the ring now and records a copy into dst, made visible to compute shaders
+    void upload(VkCommandBuffer commandBuffer, VkBuffer dst, VkDeviceSize dstOffset, const void * data, VkDeviceSize size);
+
+    // records a copy of src (written by a compute shader) into the ring; the returned pointer holds
+    // the data once the batch completes and stays valid until the ring needs the space again
+    const void * readback(VkCommandBuffer commandBuffer, VkBuffer src, VkDeviceSize srcOffset, VkDeviceSize size);
+
+    void endBatch(const job_future& completion);
+
+private:
+    struct region {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        bool closed;
+        job_future completion;
+    };
+
+    context& ctx;
+    bool computeBarriers;
+    bool timestamps;
+    VkDeviceSize capacity;
+    VkDeviceSize alignment;
+    VkDeviceSize head;
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    char * pMapped;
+    std::deque<region> regions;
+
+    VkDeviceSize allocate(VkDeviceSize size);
+
+    void reclaim(bool wait);
+};
+
+#endif
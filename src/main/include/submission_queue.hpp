@@ -0,0 +1,89 @@
+#ifndef SUBMISSION_QUEUE_HPP_
+#define SUBMISSION_QUEUE_HPP_
+
+#include "volk.h"
+
+#include "context.hpp"
+
+#include <cstdint>
+
+#include <functional>
+#include <vector>
+
+struct submission_queue;
+
+// Completion handle for one submission. A default-constructed future is already complete.
+struct job_future {
+    job_future();
+
+    bool isReady() const;
+
+    void wait() const;
+
+private:
+    friend struct submission_queue;
+
+    submission_queue * queue;
+    std::uint64_t ticket;
+
+    job_future(submission_queue * queue, std::uint64_t ticket);
+};
+
+// Keeps up to slotCount submissions in flight on one VkQueue.
+//
+// Each slot owns a command pool, a primary command buffer and a fence. submit() takes the next slot
+// in ring order, blocking only if that slot's previous job is still executing, so the host can record
+// job k+1 while the GPU runs job k. Fences on one queue signal in submission order, which lets a
+// single completed-ticket counter answer isReady() for every older job.
+struct submission_queue {
+    static constexpr std::uint32_t DEFAULT_SLOT_COUNT = 3;
+
+    submission_queue(context& ctx, std::uint32_t queueFamilyIndex, std::uint32_t queueIndex = 0, std::uint32_t slotCount = DEFAULT_SLOT_COUNT);
+
+    // waits for every job still in flight
+    ~submission_queue();
+
+    submission_queue(const submission_queue&) = delete;
+
+    submission_queue& operator=(const submission_queue&) = delete;
+
+    // records into the slot's command buffer (reset before the callback runs) and submits it
+    job_future submit(const std::function<void(VkCommandBuffer)>& recorder);
+
+    // submits a command buffer recorded elsewhere; it must allow simultaneous use if it can be in flight twice
+    job_future submit(VkCommandBuffer commandBuffer);
+
+    void waitIdle();
+
+    std::uint32_t getQueueFamilyIndex() const;
+
+private:
+    friend struct job_future;
+
+    struct slot {
+        VkCommandPool commandPool;
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        std::uint64_t ticket;
+    };
+
+    context& ctx;
+    std::uint32_t queueFamilyIndex;
+    VkQueue queue;
+    std::vector<slot> slots;
+    std::uint64_t nextTicket;
+    std::uint64_t completedTicket;
+
+    slot& acquireSlot();
+
+    job_future submit(slot& s, VkCommandBuffer commandBuffer);
+
+    bool poll(std::uint64_t ticket);
+
+    void wait(std::uint64_t ticket);
+
+    // marks every ticket up to this one as complete and reports it to the profiler
+    void complete(std::uint64_t ticket);
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef UTIL_HPP_
+#define UTIL_HPP_
+
+#include "volk.h"
+
+#include <string>
+#include <vector>
+
+std::string translateVulkanResult(VkResult result);
+
+void vkAssert(VkResult result);
+
+std::vector<char> readFile(const std::string& fileName);
+
+#endif